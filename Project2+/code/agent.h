@@ -15,18 +15,52 @@
 #include <type_traits>
 #include <algorithm>
 #include <fstream>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdio>
 #include "board.h"
+#include "bitboard.h"
 #include "action.h"
 #include "weight.h"
-struct state {
-	board board_before;
-	board board_after;
-	int reward;
-	float value;
-	state(){
-		reward = 0;
-		value = 0;
+#include "pattern.h"
+#include "telemetry.h"
+#include "transposition.h"
+#include "pool.h"
+#include "kernel.h"
+#include "simd.h"
+
+/**
+ * the afterstates of the slider in an episode, with their rewards and values, for training
+ *
+ * only the tiles of an afterstate are kept, since the features read nothing else, so a step
+ * takes 16 bytes; the storage is reused across episodes and grows to the longest episode,
+ * so that no allocation happens in steady state
+ */
+class trajectory {
+public:
+	struct step {
+		bitboard::raw after;
+		int32_t reward;
+		float value;
+	};
+
+public:
+	trajectory(size_t capacity = 4096) : steps(capacity), length(0) {}
+
+	void push(const bitboard& after, int reward, float value) {
+		if (length == steps.size()) steps.resize(steps.size() * 2);
+		steps[length++] = { after.cells(), reward, value };
 	}
+	void clear() { length = 0; }
+	size_t size() const { return length; }
+	bool empty() const { return length == 0; }
+	const step& operator [](size_t i) const { return steps[i]; }
+	bitboard after(size_t i) const { return bitboard(steps[i].after, 0); }
+
+private:
+	std::vector<step> steps;
+	size_t length;
 };
 
 class agent {
@@ -60,6 +94,15 @@ protected:
 		operator numeric() const { return numeric(std::stod(value)); }
 	};
 	std::map<key, value> meta;
+
+	/**
+	 * the seed of the engine of the given worker of a multi-threaded run, offset from 'seed'
+	 * the offsets start from 1 for 'seed=0', since the engine takes seed 0 as seed 1
+	 */
+	unsigned worker_seed(unsigned id) const {
+		unsigned seed = meta.find("seed") != meta.end() ? int(meta.at("seed")) : std::default_random_engine::default_seed;
+		return std::max(seed, 1u) + id;
+	}
 };
 
 /**
@@ -73,6 +116,8 @@ public:
 	}
 	virtual ~random_agent() {}
 
+	void seed_worker(unsigned id) { engine.seed(worker_seed(id)); }
+
 protected:
 	std::default_random_engine engine;
 };
@@ -87,62 +132,330 @@ public:
 			init_weights(meta["init"]);
 		if (meta.find("load") != meta.end())
 			load_weights(meta["load"]);
+		if (meta.find("tc") != meta.end())
+			init_coherence(meta.find("load") != meta.end() ? std::string(meta["load"]) + ".tc" : "");
 		if (meta.find("alpha") != meta.end())
 			alpha = float(meta["alpha"]);
 		if( meta.find("n_step") != meta.end())
 			n_step = int(meta["n_step"]);
 		if (meta.find("seed") != meta.end())
 			engine.seed(int(meta["seed"]));
-		if (meta.find("labmda") != meta.end())
-			engine.seed(int(meta["lambda"]));
+		if (meta.find("lambda") != meta.end())
+			lambda = float(meta["lambda"]);
+		if (meta.find("sync") != meta.end())
+			sync_every = meta.find("sync_every") != meta.end() ? size_t(meta["sync_every"]) : 1000;
+		if (sync_every && tc.size()) {
+			std::cerr << "the coherence tables of tc are not averaged by sync=, and cannot be used with it" << std::endl;
+			std::exit(-1);
+		}
 	}
 	virtual ~weight_agent() {
-		if (meta.find("save") != meta.end())
+		for (size_t k = 0; clash.use_count() == 1 && k < clash->size(); k++) {
+			if (!feature[k].hashed()) continue;
+			std::cout << "hashed (" << feature[k].name() << "): ";
+			(*clash)[k].report(std::cout);
+		}
+		if (sync_every && sync_count % sync_every)
+			synchronize(); // the episodes since the last round, so that every worker saves the same average
+		if (meta.find("save") != meta.end() && net.size())
 			save_weights(meta["save"]);
+		if (meta.find("save") != meta.end() && net.size() && tc.size()) // none without the float weights, e.g., after quantization
+			save_coherence(std::string(meta["save"]) + ".tc");
+	}
+
+	void seed_worker(unsigned id) { engine.seed(worker_seed(id)); }
+
+	/**
+	 * the weight tables, and rebinding them to tables of the same layout held elsewhere,
+	 * e.g., a read-only snapshot for an actor of actor-learner training
+	 */
+	const std::vector<weight>& weights() const { return net; }
+	void bind(const std::vector<weight>& tables) { net = tables; }
+
+	/**
+	 * the bytes of the arenas that hold the weight tables, including those for quantization and TC
+	 */
+	size_t memory() const {
+		return (mem ? mem->size() : 0) + (qmem ? qmem->size() : 0) + (tc_mem ? tc_mem->size() : 0);
+	}
+	/**
+	 * whether the weights are averaged with other processes, see synchronize()
+	 */
+	bool synced() const { return sync_every != 0; }
+	/**
+	 * the page type of the arenas, selected by 'page', see arena::mode
+	 */
+	arena::mode page() const {
+		return arena::parse(meta.find("page") != meta.end() ? std::string(meta.at("page")) : "normal");
 	}
 
 protected:
+	/**
+	 * initialize the tuples and their weight tables from a tuple list or a preset name
+	 * tuples are separated by semicolons and cells by commas, e.g., "0,1,2,3,4,5;4,5,6,7,8,9"
+	 * a tuple followed by @bits is hashed into 2^bits slots, e.g., "0,1,2,3,4,5,6@24"
+	 */
 	virtual void init_weights(const std::string& info) {
-		// std::string res = info; // comma-separated sizes, e.g., "65536,65536"
-		// for (char& ch : res)
-		// 	if (!std::isdigit(ch)) ch = ' ';
-		// std::stringstream in(res);
-		// for (size_t size; in >> size; net.emplace_back(size));
-
-		//use 16 since it's hard to get 16th value(98304)
-		int table_size = 16 * 16 * 16 * 16 * 16 * 16;
-		net.emplace_back(table_size);
-		net.emplace_back(table_size);
-		net.emplace_back(table_size);
-		net.emplace_back(table_size);
-		// net.emplace_back(table_size);
-		// net.emplace_back(table_size);
-		// net.emplace_back(table_size);
-		// net.emplace_back(table_size);
+		init_features(info);
+		allocate_weights();
+	}
+	/**
+	 * carve the weight tables of all tuples out of a single arena
+	 * the page type of the arena is selected by 'page', see arena::mode
+	 */
+	virtual void allocate_weights() {
+		std::vector<size_t> sizes;
+		std::vector<char*> slices;
+		for (const pattern& p : feature) sizes.push_back(p.size() * sizeof(weight::type));
+		mem = arena::carve(sizes, page(), slices);
+		mem->report(std::cout);
+		net.clear();
+		clash = std::make_shared<std::vector<collision>>();
+		for (size_t k = 0; k < feature.size(); k++) {
+			net.emplace_back(reinterpret_cast<weight::type*>(slices[k]), feature[k].size());
+			clash->emplace_back(feature[k].hashed() ? feature[k].size() : 0);
+		}
 	}
+	virtual void init_features(const std::string& info) {
+		std::string res = info;
+		while (presets().count(res)) res = presets().at(res);
+		feature.clear();
+		std::stringstream tuples(res);
+		for (std::string tuple; std::getline(tuples, tuple, ';'); ) {
+			unsigned bits = 0;
+			if (tuple.find('@') != std::string::npos) {
+				bits = std::stoul("0" + tuple.substr(tuple.find('@') + 1));
+				tuple = tuple.substr(0, tuple.find('@'));
+			}
+			for (char& ch : tuple)
+				if (!std::isdigit(ch)) ch = ' ';
+			std::stringstream in(tuple);
+			std::vector<unsigned> cells;
+			for (unsigned cell; in >> cell; cells.push_back(cell)) {
+				if (cell < 16) continue;
+				std::cerr << "invalid cell " << cell << " in tuple init=" << info << std::endl;
+				std::exit(-1);
+			}
+			if (cells.empty()) continue;
+			if (cells.size() > pattern::max_length) {
+				std::cerr << "tuple longer than " << pattern::max_length << " cells in init=" << info << std::endl;
+				std::exit(-1);
+			}
+			if (bits && (bits > 32 || bits >= 4 * cells.size())) {
+				std::cerr << "hashed table of 2^" << bits << " slots is not smaller than its tuple in init=" << info << std::endl;
+				std::exit(-1);
+			}
+			feature.emplace_back(cells, bits);
+			if (!feature.back().verify()) {
+				std::cerr << "tuple " << feature.back().name() << " mismatches its cells in init=" << info << std::endl;
+				std::exit(-1);
+			}
+		}
+		if (feature.empty()) {
+			std::cerr << "no tuple is defined by init=" << info << std::endl;
+			std::exit(-1);
+		}
+	}
+	/**
+	 * named tuple sets, where 'init' without a value uses the 4x6-tuple network
+	 */
+	static const std::map<std::string, std::string>& presets() {
+		static const std::map<std::string, std::string> m = {
+			{ "init", "4x6" },
+			{ "4x6", "0,1,2,3,4,5;4,5,6,7,8,9;5,6,7,9,10,11;9,10,11,13,14,15" },
+			{ "8x6", "0,1,2,4,5,6;1,2,5,6,9,13;0,1,2,3,4,5;0,1,5,6,7,10;0,1,2,5,9,10;0,1,5,9,13,14;0,1,5,8,9,13;0,1,2,4,6,10" },
+		};
+		return m;
+	}
+
+	/**
+	 * replace the float tables by quantized tables of the given format for evaluation,
+	 * after which the float tables are released and no update is possible
+	 */
+	virtual void quantize_weights(qweight::format type) {
+		std::vector<size_t> sizes;
+		std::vector<char*> slices;
+		for (const weight& w : net) sizes.push_back(w.size() * sizeof(uint16_t));
+		qmem = arena::carve(sizes, page(), slices);
+		qmem->report(std::cout);
+		qnet.clear();
+		for (size_t k = 0; k < net.size(); k++)
+			qnet.push_back(qweight::quantize(net[k], reinterpret_cast<uint16_t*>(slices[k]), type));
+		net.clear();
+		mem.reset();
+	}
+
+	/**
+	 * the weight file begins with a header of the tuples, followed by the tables
+	 * files without the header are from the fixed 4x6-tuple network
+	 */
 	virtual void load_weights(const std::string& path) {
 		std::ifstream in(path, std::ios::in | std::ios::binary);
 		if (!in.is_open()) std::exit(-1);
+		read_header(in, path);
+		allocate_weights();
+		for (weight& w : net) in >> w;
+		if (!in) {
+			std::cerr << "tuples mismatch the weight tables in " << path << std::endl;
+			std::exit(-1);
+		}
+		in.close();
+	}
+	/**
+	 * read the tuples from the header of a weight file into 'feature'
+	 */
+	virtual void read_header(std::istream& in, const std::string& path) {
 		uint32_t size;
 		in.read(reinterpret_cast<char*>(&size), sizeof(size));
-		net.resize(size);
+		if (size == header) {
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			feature.resize(size);
+			for (pattern& p : feature) {
+				if (in >> p && p.verify()) continue;
+				std::cerr << "tuples mismatch the weight tables in " << path << std::endl;
+				std::exit(-1);
+			}
+		} else {
+			init_features("4x6");
+		}
+		if (feature.size() != size) {
+			std::cerr << "tuples mismatch the weight tables in " << path << std::endl;
+			std::exit(-1);
+		}
+	}
+	/**
+	 * open a weight file of the same tuples, positioned at its first table
+	 */
+	std::ifstream open_same(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) std::exit(-1);
+		std::vector<pattern> own = feature;
+		read_header(in, path);
+		for (size_t k = 0; k < own.size(); k++) {
+			if (own[k].name() == feature[k].name()) continue;
+			std::cerr << "tuples mismatch the weight tables in " << path << std::endl;
+			std::exit(-1);
+		}
+		return in;
+	}
+
+	/**
+	 * average the weights of all workers through a shared directory, every 'sync_every' episodes
+	 *
+	 * every worker publishes its weights as w<worker>.r<round>.bin in 'sync', then worker 0
+	 * averages those of all 'workers' into avg.r<round>.bin, which every worker reloads in place
+	 * a file is always written under a temporary name and then renamed, so that no reader sees
+	 * a partial file, even on a shared NFS mount; the directory should be fresh for each run
+	 * a last round is run at exit for the remaining episodes, so all workers should run the same total
+	 */
+	void synchronize() {
+		std::string dir = meta["sync"];
+		size_t id = meta.find("worker") != meta.end() ? size_t(meta["worker"]) : 0;
+		size_t workers = meta.find("workers") != meta.end() ? size_t(meta["workers"]) : 1;
+		size_t round = sync_round++;
+		auto file = [&](const std::string& name, size_t r) { return dir + "/" + name + ".r" + std::to_string(r) + ".bin"; };
+		auto publish = [&](const std::string& path) {
+			save_weights(path + ".tmp");
+			if (std::rename((path + ".tmp").c_str(), path.c_str()) == 0) return;
+			std::cerr << "cannot publish " << path << std::endl;
+			std::exit(-1);
+		};
+		auto wait = [](const std::string& path) {
+			while (!std::ifstream(path).good()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		};
+
+		publish(file("w" + std::to_string(id), round));
+		if (id == 0) {
+			std::vector<float> buf(1 << 16);
+			for (size_t i = 1; i < workers; i++) {
+				std::string path = file("w" + std::to_string(i), round);
+				wait(path);
+				std::ifstream in = open_same(path);
+				for (weight& w : net) {
+					uint64_t size = 0;
+					in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+					for (size_t j = 0; j < size && in; j += buf.size()) {
+						size_t n = std::min(buf.size(), size - j);
+						in.read(reinterpret_cast<char*>(buf.data()), sizeof(float) * n);
+						for (size_t x = 0; x < n; x++) w[j + x] += buf[x];
+					}
+					if (size != w.size() || !in) {
+						std::cerr << "tuples mismatch the weight tables in " << path << std::endl;
+						std::exit(-1);
+					}
+				}
+			}
+			for (weight& w : net)
+				for (size_t j = 0; j < w.size(); j++) w[j] /= float(workers);
+			publish(file("avg", round));
+			for (size_t i = 0; i < workers; i++) std::remove(file("w" + std::to_string(i), round).c_str());
+			if (round) std::remove(file("avg", round - 1).c_str());
+		}
+		std::string avg = file("avg", round);
+		wait(avg);
+		std::ifstream in = open_same(avg);
 		for (weight& w : net) in >> w;
-		in.close();
+		if (!in) {
+			std::cerr << "tuples mismatch the weight tables in " << avg << std::endl;
+			std::exit(-1);
+		}
+		std::cout << "sync: round " << round << ", " << workers << " workers averaged in " << avg << std::endl;
 	}
+	/**
+	 * allocate the tables of temporal coherence learning, see coherence
+	 * they are saved beside the weights as <path>.tc, and start from zero if no such file exists
+	 */
+	virtual void init_coherence(const std::string& path) {
+		std::vector<size_t> sizes;
+		std::vector<char*> slices;
+		for (const weight& w : net) sizes.push_back(w.size() * sizeof(coherence::entry));
+		tc_mem = arena::carve(sizes, page(), slices);
+		tc.clear();
+		for (size_t k = 0; k < net.size(); k++)
+			tc.emplace_back(reinterpret_cast<coherence::entry*>(slices[k]), net[k].size());
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return;
+		for (coherence& c : tc) in >> c;
+		if (!in) {
+			std::cerr << "tuples mismatch the coherence tables in " << path << std::endl;
+			std::exit(-1);
+		}
+	}
+	virtual void save_coherence(const std::string& path) {
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) std::exit(-1);
+		for (coherence& c : tc) out << c;
+		out.close();
+	}
+
 	virtual void save_weights(const std::string& path) {
 		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
 		if (!out.is_open()) std::exit(-1);
+		uint32_t magic = header;
+		out.write(reinterpret_cast<char*>(&magic), sizeof(magic));
 		uint32_t size = net.size();
 		out.write(reinterpret_cast<char*>(&size), sizeof(size));
+		for (pattern& p : feature) out << p;
 		for (weight& w : net) out << w;
 		out.close();
 	}
 
 protected:
+	static constexpr uint32_t header = 0x7075746e; // "ntup"
+	std::vector<pattern> feature;
+	std::shared_ptr<arena> mem;
 	std::vector<weight> net;
+	std::shared_ptr<std::vector<collision>> clash;
+	std::shared_ptr<arena> tc_mem;
+	std::vector<coherence> tc;
+	std::shared_ptr<arena> qmem;
+	std::vector<qweight> qnet;
 	float alpha;
 	int n_step = 0;
-	float lambda=0.95;
+	float lambda = 0;
+	size_t sync_every = 0;
+	size_t sync_count = 0;
+	size_t sync_round = 0;
 	std::default_random_engine engine;
 };
 
@@ -161,6 +474,14 @@ public:
 	}
 
 	virtual action take_action(const board& after, float& state_value, int& r) {
+		return take_action(after);
+	}
+
+	/**
+	 * select a placement on either board representation
+	 */
+	template<typename state>
+	action take_action(const state& after) {
 		std::vector<int> space = spaces[after.last()];
 		std::shuffle(space.begin(), space.end(), engine);
 		for (int pos : space) {
@@ -208,219 +529,736 @@ private:
 class learning_slider : public weight_agent {
 public:
 	learning_slider(const std::string& args = "") : weight_agent(args), opcode({ 0, 1, 2, 3 }), space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }) {
+		select_kernel();
+		std::cout << "tuples:";
+		for (const pattern& p : feature) std::cout << " (" << p.name() << ")";
+		std::cout << (vectorized ? " [avx2]" : unrolled ? " [unrolled]" : " [generic]") << std::endl;
+		if (meta.find("quant") != meta.end())
+			quantize(qweight::parse(meta["quant"]));
 		std::cout << "n_step:" << n_step << std::endl;
 		std::cout << "lambda: " << lambda << std::endl;
+		if (tc.size()) std::cout << "tc: on" << std::endl;
+		if (meta.find("budget") != meta.end())
+			budget = double(meta["budget"]) * 1000;
+		if (meta.find("game_budget") != meta.end())
+			game_budget = double(meta["game_budget"]) * 1000;
+		if (timed()) depth = 4;
+		if (meta.find("depth") != meta.end())
+			depth = int(meta["depth"]);
+		if (depth < 1 || depth > 4) {
+			std::cerr << "depth=" << depth << " is not in 1..4" << std::endl;
+			std::exit(-1);
+		}
+		if (depth > 1) std::cout << "depth: " << depth << (timed() ? " (iterative deepening)" : "") << std::endl;
+		if (meta.find("tt") != meta.end()) {
+			unsigned bits = int(meta["tt"]);
+			if (bits < 10 || bits > 32) {
+				std::cerr << "tt=" << bits << " is not in 10..32" << std::endl;
+				std::exit(-1);
+			}
+			cache = std::make_shared<transposition>(bits);
+			cache_leaves = meta.find("tt_leaf") != meta.end();
+		}
+		if (meta.find("split") != meta.end() && int(meta["split"]) > 1) {
+			unsigned threads = int(meta["split"]);
+			auto pool = std::make_shared<splitter>(threads);
+			for (unsigned id = 1; id < threads; id++)
+				pool->helper.emplace_back(new learning_slider(worker(id)));
+			split = pool;
+			std::cout << "split: " << threads << " threads" << std::endl;
+		}
+	}
+	~learning_slider() {
+		split.reset();
+		if (timed() && counters.use_count() == 1 && !snapshot_bound) {
+			std::cout << "depth: ";
+			counters->depths(std::cout);
+		}
+		if (!cache) return;
+		cache->merge(cache_count);
+		if (cache.use_count() > 1 || snapshot_bound) return;
+		std::cout << "tt: ";
+		cache->report(std::cout);
 	}
 
+	/**
+	 * the afterstates below the chance nodes of a move decision, evaluated as a batch
+	 * there are at most 4 candidates, 4 placements per candidate, and 4 slides per placement
+	 */
+	struct frontier {
+		bitboard after[64];
+		board::reward reward[64];
+		float value[64];
+		size_t size = 0;
+	};
+	/**
+	 * a chance node, whose afterstates begin at 'begin' in the frontier, grouped by placement
+	 * where count[i] is the number of legal slides after the i-th placement
+	 */
+	struct chance {
+		size_t begin;
+		int num_empty;
+		size_t count[4];
+	};
+	/**
+	 * the candidates of a move decision, i.e., the chance nodes after the legal slides
+	 * and their immediate rewards, and the afterstates below them
+	 */
+	struct decision {
+		frontier leaves;
+		chance node[4];
+		board::reward reward[4];
+	};
+
 	virtual action take_action(const board& before, float& state_value, int& r) {
+		bitboard b(before);
+		action move;
+		take_actions(&b, 1, &move, &state_value, &r);
+		return move;
+	}
+
+	/**
+	 * select the moves of many boards at once, where the afterstates below the candidates
+	 * of all boards are evaluated in a single batch
+	 * the value and the reward of a board are left untouched if it has no legal move
+	 */
+	void take_actions(const bitboard* before, size_t n, action* move, float* state_value, int* r) {
+		if (depth > 1 || timed()) {
+			for (size_t i = 0; i < n; i++)
+				move[i] = timed() ? deepen(before[i], state_value[i], r[i]) : search(before[i], state_value[i], r[i]);
+			tally.slides += n;
+			return;
+		}
+		if (decisions.size() < n) decisions.resize(n);
+		size_t total = 0;
+		for (size_t i = 0; i < n; i++) {
+			decision& d = decisions[i];
+			d.leaves.size = 0;
+			for(int op : opcode){
+				bitboard tmp = before[i];
+				d.reward[op] = tmp.slide(op);
+				if (d.reward[op] == -1) {
+					continue;
+				}
+				d.node[op] = expand(tmp, op, d.leaves);
+			}
+			total += d.leaves.size;
+		}
+		tally.slides += n;
+		tally.estimates += total;
+		if (n == 1) {
+			estimate_batch(decisions[0].leaves.after, decisions[0].leaves.size, decisions[0].leaves.value);	//evaluate all afterstates below the candidates by the n-tuple network
+		} else {
+			if (batch_after.size() < total) batch_after.resize(total), batch_value.resize(total);
+			for (size_t i = 0, j = 0; i < n; j += decisions[i++].leaves.size)
+				std::copy(decisions[i].leaves.after, decisions[i].leaves.after + decisions[i].leaves.size, batch_after.begin() + j);
+			estimate_batch(batch_after.data(), total, batch_value.data());
+			for (size_t i = 0, j = 0; i < n; j += decisions[i++].leaves.size)
+				std::copy(batch_value.begin() + j, batch_value.begin() + j + decisions[i].leaves.size, decisions[i].leaves.value);
+		}
+		for (size_t i = 0; i < n; i++)
+			move[i] = select(decisions[i], state_value[i], r[i]);
+	}
+
+	//select the candidate with the best sum of the immediate reward and the expected value
+	action select(const decision& d, float& state_value, int& r) const {
+		float q_value[4];
+		for (int op : opcode)
+			if (d.reward[op] != -1) q_value[op] = reduce(d.node[op], d.leaves);
+		return pick(d.reward, q_value, state_value, r);
+	}
+
+	/**
+	 * the legal move with the best sum of its reward and its afterstate value, or no action if none
+	 * the state value and the reward are left untouched if the board has no legal move
+	 */
+	action pick(const board::reward* reward, const float* q_value, float& state_value, int& r) const {
 		float best_total = -999999;
-		int best_reward = -999999;
-		float best_state_value = -999999;
 		int best_op = -1;
-		for(int op : opcode){
-			board tmp = board(before);
-			board::reward reward = tmp.slide(op);
-			if (reward == -1) {
-				continue;
-			}
-			float q_value = expect_value(tmp, op);	//evaluate the afterstate values by the n-tuple network
-			float v = reward + q_value;				//sum up immediate rewards and afterstate values
-			if (v > best_total) {
-				best_total = v;
+		for (int op : opcode) {
+			if (reward[op] == -1) continue;
+			if (reward[op] + q_value[op] > best_total) {
+				best_total = reward[op] + q_value[op];
 				best_op = op;
-				best_reward = reward;
-				best_state_value = q_value;
+				state_value = q_value[op];
+				r = reward[op];
 			}
+		}
+		return best_op == -1 ? action() : action::slide(best_op);
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		game_spent = 0;
+		game_moves = 0;
+	}
+	virtual void close_episode(const std::string& flag = "") {
+		games_played++;
+		moves_played += game_moves;
+		auto now = std::chrono::steady_clock::now();
+		tally.play += std::chrono::duration<double>(now - mark).count();
+		mark = now;
+		flush();
+	}
+
+	/**
+	 * the counters shared by this slider and its worker copies, see telemetry
+	 * a copy that plays outside of training, e.g., for evaluation, may count into its own instead
+	 */
+	telemetry& meter() const { return *counters; }
+	void detach_meter() { counters = std::make_shared<telemetry>(); }
+
+	/**
+	 * whether the moves are timed by a budget per game, which is kept from open_episode()
+	 * to close_episode(), so the games of this slider must not overlap
+	 */
+	bool game_timed() const { return game_budget > 0; }
 
+	/**
+	 * a copy of this slider that shares its weight tables, for Hogwild training by many threads
+	 * the copy has its own random engine and buffers, and never saves or synchronizes the weights
+	 */
+	learning_slider worker(unsigned id) const {
+		learning_slider w(*this);
+		w.meta.erase("save");
+		w.seed_worker(id);
+		w.sync_every = 0;
+		w.tally = telemetry::tally();
+		w.cache_count = transposition::counters();
+		w.split.reset();
+		return w;
+	}
+
+	/**
+	 * a copy of this slider for a snapshot of the weight tables, see worker()
+	 * the copy has a transposition table of its own, since the shared one holds the values
+	 * of the live tables, and the table is invalidated whenever the copy is rebound
+	 */
+	learning_slider snapshot_worker(unsigned id) const {
+		learning_slider w = worker(id);
+		if (cache) w.cache = std::make_shared<transposition>(cache->log_size());
+		w.snapshot_bound = true;
+		return w;
+	}
+	void bind(const std::vector<weight>& tables) {
+		weight_agent::bind(tables);
+		if (cache) cache->advance();
+	}
+
+	/**
+	 * select the move of a board by an expectimax search of 'depth' chance layers
+	 * the state value and the reward are left untouched if the board has no legal move
+	 */
+	action search(const bitboard& before, float& state_value, int& r) {
+		bitboard after[4];
+		board::reward reward[4];
+		float q_value[4];
+		int legal[4] = { 0, 0, 0, 0 }, num = 0;
+		for (int op : opcode) {
+			after[op] = before;
+			reward[op] = after[op].slide(op);
+			if (reward[op] != -1) legal[num++] = op;
 		}
-		if(best_op == -1){
-			return action();
+		expect_all(after, legal, num, depth, q_value);
+		return pick(reward, q_value, state_value, r);
+	}
+
+	/**
+	 * the values of the afterstates of the given moves, searched 'layers' deep
+	 *
+	 * with a pool of search threads ('split=threads'), the outcomes of the chance nodes of all
+	 * the moves are split across the threads, each of which searches with a helper slider of
+	 * its own (so with scratch buffers of its own) and shares the transposition table;
+	 * the outcomes are then combined in the same order as by a single thread,
+	 * so the values are the same bit for bit
+	 */
+	void expect_all(const bitboard* after, const int* ops, int num, int layers, float* value) {
+		if (!split || layers < 2) {
+			for (int k = 0; k < num && !timed_out; k++)
+				value[ops[k]] = expect(after[ops[k]], layers);
+			return;
 		}
-		else{
-			state_value = best_state_value;
-			r = best_reward;
-			return action::slide(best_op);
+		struct part {
+			int op;
+			int pos;
+			board::cell hint;
+			float best;
+		} work[48];
+		bool found[4] = { false, false, false, false };
+		size_t tasks = 0;
+		for (int k = 0; k < num; k++) {
+			int op = ops[k];
+			found[op] = cache && cache->probe(after[op], transposition::chance, layers, value[op], cache_count);
+			if (found[op]) continue;
+			for (int p = 0; p < 4; p++) {
+				if (after[op](spaces[after[op].last()][p]) != 0) continue;
+				for (board::cell hint = 1; hint <= 3; hint++)
+					if (after[op].bag(hint)) work[tasks++] = { op, p, hint, 0.0f };
+			}
 		}
-		
+		for (auto& h : split->helper) {
+			h->net = net;
+			h->deadline = deadline;
+			h->timing = timing;
+			h->timed_out = false;
+		}
+		auto job = [&](size_t i, unsigned id) {
+			learning_slider& s = id ? *split->helper[id - 1] : *this;
+			part& w = work[i];
+			w.best = s.outcome(after[w.op], spaces[after[w.op].last()][w.pos], w.hint, layers);
+		};
+		split->pool.run(tasks, job);
+		for (auto& h : split->helper) {
+			timed_out |= h->timed_out;
+			tally.estimates += h->tally.estimates;
+			h->tally = telemetry::tally();
+			if (cache) cache->merge(h->cache_count);
+		}
+		if (timed_out) return;
+
+		for (int k = 0; k < num; k++) {
+			int op = ops[k];
+			if (found[op]) continue;
+			float best[4][4] = {};
+			for (size_t i = 0; i < tasks; i++)
+				if (work[i].op == op) best[work[i].pos][work[i].hint] = work[i].best;
+			value[op] = combine(after[op], best);
+			if (cache) cache->store(after[op], transposition::chance, layers, value[op]);
+		}
+	}
+
+	/**
+	 * select the move of a board by iterative deepening within its time budget ('budget=ms'
+	 * per move, or 'game_budget=ms' per game), searching 1, 2, ... up to 'depth' chance layers
+	 *
+	 * the first iteration always completes, and a deeper one is abandoned once the deadline
+	 * passes, as checked by steady_clock every 16 chance nodes; the move and its value are then
+	 * taken from the last completed iteration
+	 * each iteration searches the moves in the order of their values in the previous one,
+	 * so the best line is searched (and cached in the transposition table) first
+	 */
+	action deepen(const bitboard& before, float& state_value, int& r) {
+		auto start = std::chrono::steady_clock::now();
+		deadline = start + std::chrono::microseconds(int64_t(allot()));
+		bitboard after[4];
+		board::reward reward[4];
+		float q_value[4], value[4];
+		int order[4], num = 0;
+		for (int op : opcode) {
+			after[op] = before;
+			reward[op] = after[op].slide(op);
+			if (reward[op] != -1) order[num++] = op;
+		}
+		int reached = 0;
+		for (int layers = 1; layers <= depth && num; layers++) {
+			timed_out = false;
+			timing = layers > 1;
+			expect_all(after, order, num, layers, value);
+			timing = false;
+			if (timed_out) break;
+			for (int k = 0; k < num; k++) q_value[order[k]] = value[order[k]];
+			reached = layers;
+			std::stable_sort(order, order + num, [&](int a, int b) { return reward[a] + q_value[a] > reward[b] + q_value[b]; });
+		}
+		timed_out = false;
+		game_spent += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		game_moves++;
+		tally.depth[reached]++;
+		return pick(reward, q_value, state_value, r);
+	}
+
+	/**
+	 * the time budget of the next move in microseconds, where a game budget is shared evenly
+	 * by the moves expected to remain, from the average length of the games played so far
+	 */
+	double allot() const {
+		if (game_budget <= 0) return budget;
+		double expected = games_played ? double(moves_played) / games_played : 500;
+		double share = std::max(game_budget - game_spent, 0.0) / std::max(expected - game_moves, 50.0);
+		return budget > 0 ? std::min(budget, share) : share;
+	}
+	bool timed() const {
+		return budget > 0 || game_budget > 0;
+	}
+
+	/**
+	 * the exact expected value of an afterstate with 'layers' chance layers below it
+	 *
+	 * every chance node enumerates the empty cells on the entering side (equally likely)
+	 * and the next hint tile (as likely as its count in the bag), and every max node takes
+	 * the best legal slide; the last layer is evaluated as a batch by the network
+	 * the boards live on the stack and the last layer reuses one frontier, so nothing is allocated
+	 *
+	 * with a transposition table ('tt=bits'), the values of chance nodes (and of leaves, with 'tt_leaf')
+	 * are looked up before they are computed, and stored after; a value found is the one that would
+	 * be computed, so the search result is unchanged
+	 * caching the leaves pays only if a network evaluation costs more than the probe of a cold entry,
+	 * which is not the case for the default 4x6-tuple network
+	 */
+	float expect(const bitboard& after, int layers) {
+		if (timing && (++ticks & 15) == 0 && std::chrono::steady_clock::now() > deadline) timed_out = true;
+		if (timed_out) return 0;
+		float value = 0.0;
+		if (cache && cache->probe(after, transposition::chance, layers, value, cache_count)) return value;
+		if (layers <= 1) {
+			probe.size = 0;
+			chance node = expand(after, after.last(), probe);
+			evaluate(probe);
+			value = reduce(node, probe);
+		} else {
+			value = expand_deep(after, layers);
+		}
+		if (cache && !timed_out) cache->store(after, transposition::chance, layers, value);
+		return value;
+	}
+
+	/**
+	 * evaluate the afterstates of a frontier as a batch, except those found in the transposition table
+	 */
+	void evaluate(frontier& leaves) {
+		if (!cache_leaves) {
+			estimate_batch(leaves.after, leaves.size, leaves.value);
+			tally.estimates += leaves.size;
+			return;
+		}
+		size_t num = 0;
+		for (size_t i = 0; i < leaves.size; i++) {
+			if (cache->probe(leaves.after[i], transposition::leaf, 0, leaves.value[i], cache_count)) continue;
+			missed.after[num] = leaves.after[i];
+			missed_at[num++] = i;
+		}
+		estimate_batch(missed.after, num, missed.value);
+		tally.estimates += num;
+		for (size_t i = 0; i < num; i++) {
+			leaves.value[missed_at[i]] = missed.value[i];
+			cache->store(missed.after[i], transposition::leaf, 0, missed.value[i]);
+		}
+	}
+
+	//expected value of a chance node with more than one layer, enumerating its outcomes
+	float expand_deep(const bitboard& after, int layers) {
+		float best[4][4] = {};
+		for (int p = 0; p < 4; p++) {
+			int i = spaces[after.last()][p];
+			if (after(i) != 0) continue;
+			for (board::cell hint = 1; hint <= 3; hint++)
+				if (after.bag(hint)) best[p][hint] = outcome(after, i, hint, layers);
+		}
+		return combine(after, best);
+	}
+
+	//the best value after placing a tile at 'pos' with the next hint 'hint', or zero if no slide is legal
+	float outcome(const bitboard& after, int pos, board::cell hint, int layers) {
+		bitboard placed = after;
+		placed.place(pos, after.hint(), hint);
+		float best = 0.0;
+		bool legal = false;
+		for (int op : opcode) {
+			bitboard next = placed;
+			board::reward reward = next.slide(op);
+			if (reward == -1) continue;
+			float v = reward + expect(next, layers - 1);
+			if (!legal || v > best) best = v, legal = true;
+		}
+		return best;
 	}
-	//function for calculate expect value for expectimax search
-	float expect_value(const board &b, int op){
-		std::vector<int> empty_tile;
+
+	//expected value of a chance node from the best values of its outcomes, by the entering cell and the hint
+	float combine(const bitboard& after, const float best[4][4]) const {
 		int num_empty = 0;
-		std::vector<int> spaces[4];
-		spaces[0] = { 12, 13, 14, 15 };
-		spaces[1] = { 0, 4, 8, 12 };
-		spaces[2] = { 0, 1, 2, 3};
-		spaces[3] = { 3, 7, 11, 15 };
-		//std::vector<int> space = spaces[b.last()];
-		std::vector<int> space = spaces[op];
-		//cout<<"EMPTY: ";
-		for(int i : space){
-			if(b(i) == 0){
-				num_empty++;
-				empty_tile.push_back(i);
-				//cout<<i<<" ";
-			} 
-		}
-		//cout<<endl;
-		int bag[3], num = 0;
-		for (board::cell t = 1; t <= 3; t++)
-			for (size_t i = 0; i < b.bag(t); i++)
-				bag[num++] = t;
-
-		std::shuffle(bag, bag + num, engine);
-		board::cell tile = b.hint();
-		board::cell hint = bag[--num];
-		//cout<<"HINT: "<<cur_tile<<endl;
+		for (int i : spaces[after.last()]) num_empty += (after(i) == 0);
+		unsigned total = after.bag(1) + after.bag(2) + after.bag(3);
 		float value = 0.0;
+		for (int p = 0; p < 4; p++) {
+			if (after(spaces[after.last()][p]) != 0) continue;
+			float expected = 0.0;
+			for (board::cell hint = 1; hint <= 3; hint++) {
+				if (after.bag(hint) == 0) continue;
+				expected += best[p][hint] * after.bag(hint) / float(total);
+			}
+			value += expected / float(num_empty);
+		}
+		return value;
+	}
 
-		for(int i : empty_tile){
-			board state1 = b;
-			state1.place(i, tile, hint);
-			//state1.set_tile(i, cur_tile);
-			board::reward best_reward1 = -1;
-			float best_value1 = -std::numeric_limits<float>::max();
-			//int best_op = -1;
 
+	//append the afterstates below a chance node to the frontier
+	chance expand(const bitboard &b, int op, frontier& leaves){
+		chance node = { leaves.size, 0, { 0, 0, 0, 0 } };
+		int empty_tile[4];
+		for(int i : spaces[op]){
+			if(b(i) == 0){
+				empty_tile[node.num_empty++] = i;
+			}
+		}
+		// the network reads no hint, so the leaves of all hints have the same value, and one hint stands for them
+		board::cell tile = b.hint();
+		board::cell hint = b.bag(1) ? 1 : b.bag(2) ? 2 : 3;
+
+		for(int k = 0; k < node.num_empty; k++){
+			bitboard state1 = b;
+			state1.place(empty_tile[k], tile, hint);
 			for(int op1 : opcode){
-				board after1 = state1;
+				bitboard after1 = state1;
 				board::reward reward1 = after1.slide(op1);
 				if(reward1 < 0) continue;
-				
-				float value1 = estimate_value(after1);
-				if(reward1 + value1 > best_reward1 + best_value1) {
-					best_reward1 = reward1;
-					best_value1 = value1;
+				leaves.after[leaves.size] = after1;
+				leaves.reward[leaves.size] = reward1;
+				leaves.size++;
+				node.count[k]++;
+			}
+		}
+		return node;
+	}
+
+	//expected value of a chance node, from the evaluated afterstates of the frontier
+	float reduce(const chance& node, const frontier& leaves) const {
+		float value = 0.0;
+		size_t j = node.begin;
+		for(int k = 0; k < node.num_empty; k++){
+			board::reward best_reward1 = -1;
+			float best_value1 = -std::numeric_limits<float>::max();
+			for(size_t c = 0; c < node.count[k]; c++, j++){
+				if(leaves.reward[j] + leaves.value[j] > best_reward1 + best_value1) {
+					best_reward1 = leaves.reward[j];
+					best_value1 = leaves.value[j];
 				}
 			}
 
 			if(best_reward1 == -1){
 				continue;
-			}		
-			value += (best_value1 + best_reward1) / float(num_empty);
+			}
+			value += (best_value1 + best_reward1) / float(node.num_empty);
 		}
-
 		return value;
 	}
 
-	//function for estimate afterstate value
-	float estimate_value(const board& bd) {
+	/**
+	 * use the unrolled kernel if the tuples are the default 4x6-tuple network
+	 * and the AVX2 path if the CPU supports it, unless disabled by 'simd=off'
+	 * the AVX2 path is verified against the scalar path before use, by the feature indices
+	 * it reads, which (unlike the values) do not depend on the current weights
+	 */
+	void select_kernel() {
+		unrolled = layout_4x6::matches(feature);
+		vectorized = false;
+		std::string mode = meta.find("simd") != meta.end() ? std::string(meta["simd"]) : "auto";
+		if (mode == "off" || !avx2_network::supported()) return;
+		simd = avx2_network(feature);
+		if (!simd.applicable()) return;
+		std::mt19937_64 gen(0);
+		std::vector<uint32_t> idx(pattern::isomorphism * feature.size());
+		for (int n = 0; n < 1000; n++) {
+			bitboard b(gen() & gen(), 0);
+			pattern::view v(b.cells());
+			simd.indices(b.cells(), idx.data());
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+				for (size_t k = 0; k < feature.size(); k++) {
+					if (idx[iso * feature.size() + k] == feature[k].index(v, iso)) continue;
+					std::cerr << "avx2 path mismatches the scalar path, disabled" << std::endl;
+					return;
+				}
+			}
+		}
+		vectorized = true;
+	}
+
+	/**
+	 * switch to quantized weights (int16 or fp16) for evaluation-only runs
+	 * the accuracy is measured against the float network on the decisions of a few greedy games
+	 */
+	void quantize(qweight::format type) {
+		struct decision {
+			bitboard after[4];
+			board::reward reward[4];
+			float exact[4];
+			int num = 0;
+		};
+		std::vector<decision> sample;
+		random_placer place("seed=0");
+		for (int game = 0; game < 20 && sample.size() < 20000; game++) {
+			bitboard b;
+			for (int i = 0; i < 9; i++) {
+				action::place place_action = place.take_action(b);
+				b.place(place_action.position(), place_action.tile(), place_action.hint());
+			}
+			while (true) {
+				decision d;
+				for (int op : opcode) {
+					bitboard after = b;
+					board::reward reward = after.slide(op);
+					if (reward == -1) continue;
+					d.after[d.num] = after;
+					d.reward[d.num] = reward;
+					d.exact[d.num] = estimate_value(after);
+					d.num++;
+				}
+				if (d.num == 0) break;
+				int best = 0;
+				for (int i = 1; i < d.num; i++)
+					if (d.reward[i] + d.exact[i] > d.reward[best] + d.exact[best]) best = i;
+				b = d.after[best];
+				sample.push_back(d);
+				action::place place_action = place.take_action(b);
+				b.place(place_action.position(), place_action.tile(), place_action.hint());
+			}
+		}
+
+		size_t bytes = 0;
+		for (const weight& w : net) bytes += w.size() * sizeof(weight::type);
+		quantize_weights(type);
+		quantized = true;
+
+		double err = 0, err_max = 0, mag = 0;
+		size_t count = 0, same = 0;
+		for (const decision& d : sample) {
+			int best = 0, best_q = 0;
+			float value_q[4];
+			for (int i = 0; i < d.num; i++) {
+				value_q[i] = estimate_value(d.after[i]);
+				err += std::abs(value_q[i] - d.exact[i]);
+				err_max = std::max<double>(err_max, std::abs(value_q[i] - d.exact[i]));
+				mag += std::abs(d.exact[i]);
+				count++;
+				if (d.reward[i] + d.exact[i] > d.reward[best] + d.exact[best]) best = i;
+				if (d.reward[i] + value_q[i] > d.reward[best_q] + value_q[best_q]) best_q = i;
+			}
+			same += (best == best_q);
+		}
+		std::cout << "quant=" << (type == qweight::fp16 ? "fp16" : "int16") << ": " << (bytes >> 21) << "M (float " << (bytes >> 20) << "M)";
+		std::cout << ", mean |error| = " << (err / count) << " (" << (100 * err / mag) << "% of mean |value|)";
+		std::cout << ", max |error| = " << err_max;
+		std::cout << ", same decisions = " << (100.0 * same / sample.size()) << "% of " << sample.size() << std::endl;
+		if (meta.find("save") != meta.end())
+			std::cerr << "quantized weights are evaluation-only, save=" << std::string(meta["save"]) << " is ignored" << std::endl;
+	}
+
+	//function for estimate afterstate value, summed over all isomorphisms of every tuple
+	float estimate_value(const bitboard& bd) const {
+		if (quantized) {
+			float value;
+			estimate_batch(&bd, 1, &value);
+			return value;
+		}
+		if (vectorized) return simd.estimate(net.data(), bd.cells());
+		if (unrolled) return layout_4x6::estimate(net.data(), bd.cells());
+		pattern::view x(bd.cells());
 		float sum = 0.0;
-		board tmp = board(bd);
-		
-		for (int i = 0; i < 4; ++i) {
-			int idx0 = hash_function1(tmp);
-			int idx1 = hash_function2(tmp);
-			int idx2 = hash_function3(tmp);
-			int idx3 = hash_function4(tmp);
-			// int idx0 = hash_function(tmp,0,1,2,4,5,6);
-			// int idx1 = hash_function(tmp,1,2,5,6,9,13);
-			// int idx2 = hash_function(tmp,0,1,2,3,4,5);
-			// int idx3 = hash_function(tmp,0,1,5,6,7,10);
-			// int idx4 = hash_function(tmp,0,1,2,5,9,10);
-			// int idx5 = hash_function(tmp,0,1,5,9,13,14);
-			// int idx6 = hash_function(tmp,0,1,5,8,9,13);
-			// int idx7 = hash_function(tmp,0,1,2,4,6,10);
-			sum += (net[0][idx0] + net[1][idx1] + net[2][idx2] + net[3][idx3]);
-			tmp.rotate_clockwise();
-		}
-
-		tmp.reflect_horizontal();
-
-		for (int i = 0; i < 4; ++i) {
-			int idx0 = hash_function1(tmp);
-			int idx1 = hash_function2(tmp);
-			int idx2 = hash_function3(tmp);
-			int idx3 = hash_function4(tmp);
-			// int idx0 = hash_function(tmp,0,1,2,4,5,6);
-			// int idx1 = hash_function(tmp,1,2,5,6,9,13);
-			// int idx2 = hash_function(tmp,0,1,2,3,4,5);
-			// int idx3 = hash_function(tmp,0,1,5,6,7,10);
-			// int idx4 = hash_function(tmp,0,1,2,5,9,10);
-			// int idx5 = hash_function(tmp,0,1,5,9,13,14);
-			// int idx6 = hash_function(tmp,0,1,5,8,9,13);
-			// int idx7 = hash_function(tmp,0,1,2,4,6,10);
-			sum += (net[0][idx0] + net[1][idx1] + net[2][idx2] + net[3][idx3]);
-			tmp.rotate_clockwise();
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+			float part = net[0][feature[0].index(x, iso)];
+			for (size_t k = 1; k < feature.size(); k++)
+				part += net[k][feature[k].index(x, iso)];
+			sum += part;
 		}
-		
 		return sum;
+	}
 
+	/**
+	 * estimate the values of many afterstates at once
+	 * the feature indices of all afterstates are computed first, then the table loads
+	 * of the next few afterstates are prefetched while the current one is summed up,
+	 * so the memory latency of their random loads overlaps
+	 */
+	void estimate_batch(const bitboard* b, size_t n, float* out) const {
+		size_t stride = pattern::isomorphism * feature.size();
+		if (index_buffer.size() < n * stride) index_buffer.resize(n * stride);
+		uint32_t* idx = index_buffer.data();
+		for (size_t i = 0; i < n; i++)
+			feature_indices(b[i], idx + i * stride);
+		size_t ahead = std::min<size_t>(n, prefetch_distance);
+		for (size_t i = 0; i < ahead; i++)
+			prefetch(idx + i * stride);
+		for (size_t i = 0; i < n; i++) {
+			if (i + ahead < n) prefetch(idx + (i + ahead) * stride);
+			out[i] = quantized ? quantized_sum(idx + i * stride) : unrolled ? layout_4x6::sum(net.data(), idx + i * stride) : feature_sum(idx + i * stride);
+		}
 	}
 
-	//function for modify feature weight
-	void adjust_value(const board& b, float final_tderror) {
-		board tmp = board(b);
-
-		for (int i = 0; i < 4; ++i) {
-			int idx0 = hash_function1(tmp);
-			int idx1 = hash_function2(tmp);
-			int idx2 = hash_function3(tmp);
-			int idx3 = hash_function4(tmp);
-			// int idx0 = hash_function(tmp,0,1,2,4,5,6);
-			// int idx1 = hash_function(tmp,1,2,5,6,9,13);
-			// int idx2 = hash_function(tmp,0,1,2,3,4,5);
-			// int idx3 = hash_function(tmp,0,1,5,6,7,10);
-			// int idx4 = hash_function(tmp,0,1,2,5,9,10);
-			// int idx5 = hash_function(tmp,0,1,5,9,13,14);
-			// int idx6 = hash_function(tmp,0,1,5,8,9,13);
-			// int idx7 = hash_function(tmp,0,1,2,4,6,10);
-			net[0][idx0] += final_tderror;
-			net[1][idx1] += final_tderror;
-			net[2][idx2] += final_tderror;
-			net[3][idx3] += final_tderror;
-			// net[4][idx4] += final_tderror;
-			// net[5][idx5] += final_tderror;
-			// net[6][idx6] += final_tderror;
-			// net[7][idx7] += final_tderror;
-			tmp.rotate_clockwise();
-		}
-
-		tmp.reflect_horizontal();
-		
-		for (int i = 0; i < 4; ++i) {
-			int idx0 = hash_function1(tmp);
-			int idx1 = hash_function2(tmp);
-			int idx2 = hash_function3(tmp);
-			int idx3 = hash_function4(tmp);
-			// int idx0 = hash_function(tmp,0,1,2,4,5,6);
-			// int idx1 = hash_function(tmp,1,2,5,6,9,13);
-			// int idx2 = hash_function(tmp,0,1,2,3,4,5);
-			// int idx3 = hash_function(tmp,0,1,5,6,7,10);
-			// int idx4 = hash_function(tmp,0,1,2,5,9,10);
-			// int idx5 = hash_function(tmp,0,1,5,9,13,14);
-			// int idx6 = hash_function(tmp,0,1,5,8,9,13);
-			// int idx7 = hash_function(tmp,0,1,2,4,6,10);
-			net[0][idx0] += final_tderror;
-			net[1][idx1] += final_tderror;
-			net[2][idx2] += final_tderror;
-			net[3][idx3] += final_tderror;
-			// net[4][idx4] += final_tderror;
-			// net[5][idx5] += final_tderror;
-			// net[6][idx6] += final_tderror;
-			// net[7][idx7] += final_tderror;
-			tmp.rotate_clockwise();
-		}
-	}
-
-	//function for feature extraction and index encoding. Using 16 since it's hard to get the 16th value(98304)
-	int hash_function1(const board& after) const {
-		return after(0) * 16 * 16 * 16 * 16 * 16 + after(1) * 16 * 16 * 16 * 16 + after(2) * 16 * 16 * 16 + after(3) * 16 * 16 + after(4) * 16 + after(5);
-	}
-	int hash_function2(const board& after) const {
-		return after(4) * 16 * 16 * 16 * 16 * 16 + after(5) * 16 * 16 * 16 * 16 + after(6) * 16 * 16 * 16 + after(7) * 16 * 16 + after(8) * 16 + after(9);
-	}
-	int hash_function3(const board& after) const {
-		return after(5) * 16 * 16 * 16 * 16 * 16 + after(6) * 16 * 16 * 16 * 16 + after(7) * 16 * 16 * 16 + after(9) * 16 * 16 + after(10) * 16 + after(11);
-	}
-	int hash_function4(const board& after) const {
-		return after(9) * 16 * 16 * 16 * 16 * 16 + after(10) * 16 * 16 * 16 * 16 + after(11) * 16 * 16 * 16 + after(13) * 16 * 16 + after(14) * 16 + after(15);
-	}
-	// int hash_function(const board& after, int a, int b, int c, int d, int e, int f) const {
-	// 	return after(a) * 16 * 16 * 16 * 16 * 16 + after(b) * 16 * 16 * 16 * 16 + after(c) * 16 * 16 * 16 + after(d) * 16 * 16 + after(e) * 16 + after(f);
-	// }
+	//feature indices of all isomorphisms, stored as idx[iso * feature.size() + tuple]
+	void feature_indices(const bitboard& b, uint32_t* idx) const {
+		if (vectorized) return simd.indices(b.cells(), idx);
+		if (unrolled) return layout_4x6::indices(b.cells(), idx);
+		pattern::view x(b.cells());
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++)
+			for (size_t k = 0; k < feature.size(); k++)
+				*(idx++) = feature[k].index(x, iso);
+	}
+	float feature_sum(const uint32_t* idx) const {
+		float sum = 0.0;
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++, idx += feature.size()) {
+			float part = net[0][idx[0]];
+			for (size_t k = 1; k < feature.size(); k++)
+				part += net[k][idx[k]];
+			sum += part;
+		}
+		return sum;
+	}
+	float quantized_sum(const uint32_t* idx) const {
+		size_t size = feature.size();
+		const qweight* q = qnet.data();
+		float sum = 0.0;
+		if (q[0].kind() == qweight::int16) {
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++, idx += size) {
+				float part = int16_t(q[0].data()[idx[0]]) * q[0].unit();
+				for (size_t k = 1; k < size; k++)
+					part += int16_t(q[k].data()[idx[k]]) * q[k].unit();
+				sum += part;
+			}
+		} else {
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++, idx += size) {
+				float part = qweight::half_to_float(q[0].data()[idx[0]]);
+				for (size_t k = 1; k < size; k++)
+					part += qweight::half_to_float(q[k].data()[idx[k]]);
+				sum += part;
+			}
+		}
+		return sum;
+	}
+	void prefetch(const uint32_t* idx) const {
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+			for (size_t k = 0; k < feature.size(); k++, idx++) {
+				if (quantized) __builtin_prefetch(qnet[k].data() + *idx);
+				else __builtin_prefetch(net[k].data() + *idx);
+			}
+		}
+	}
 
-	float Gt2tn(std::vector<state>& path, int start, int end){					//calculate
+	/**
+	 * modify the feature weights through the indices given by feature_indices()
+	 * in temporal coherence learning, the step of each weight is scaled by |E| / A,
+	 * its accumulated error over its accumulated absolute error (1 before any error)
+	 */
+	void adjust_indices(const uint32_t* idx, float alpha_final, float td_error) {
+		if (tc.size()) {
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+				for (size_t k = 0; k < feature.size(); k++, idx++) {
+					coherence::entry& c = tc[k][*idx];
+					float beta = c.absolute > 0 ? std::abs(c.error) / c.absolute : 1;
+					net[k][*idx] += alpha_final * beta * td_error;
+					c.error += td_error;
+					c.absolute += std::abs(td_error);
+				}
+			}
+			return;
+		}
+		float final_tderror = alpha_final * td_error;
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+			for (size_t k = 0; k < feature.size(); k++)
+				net[k][*(idx++)] += final_tderror;
+		}
+	}
+	//count the writes of the hashed tuples into their collision statistics
+	void record_collisions(const bitboard& b) {
+		pattern::view x(b.cells());
+		for (size_t k = 0; k < feature.size(); k++) {
+			if (!feature[k].hashed()) continue;
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+				uint32_t key = feature[k].key(x, iso);
+				(*clash)[k].record(feature[k].slot(key), feature[k].tag(key));
+			}
+		}
+	}
+
+	float Gt2tn(trajectory& path, int start, int end){					//calculate
 		board::reward total_reward = 0;
 		float res;
 		if(end == int(path.size()-1)){
@@ -429,7 +1267,7 @@ public:
 		else{
 			total_reward = 0;
 		}
-		res = total_reward + estimate_value(path[end].board_after);
+		res = total_reward + estimate_value(path.after(end));
 		return res;
 	}
 	// void update(std::vector<state>& path) {
@@ -457,31 +1295,120 @@ public:
 		return res;
 	}
 
-	void update(std::vector<state>& path) {
+	/**
+	 * the feature indices of every afterstate of the path are computed once and cached,
+	 * then the backward pass reads the values and applies the TD errors through them
+	 * the values are re-read instead of cached, since the weights change along the pass
+	 *
+	 * the targets are computed backward in O(T), as either
+	 * n-step returns (lambda=0), where the sum of the next n rewards is kept as a sliding window
+	 * lambda-returns (lambda>0), by G(i) = r(i+1) + (1 - lambda) V(i+1) + lambda G(i+1)
+	 */
+	void update(trajectory& path) {
+		if (quantized) return;	//quantized weights are evaluation-only
+		auto start = std::chrono::steady_clock::now();
+		tally.play += std::chrono::duration<double>(start - mark).count();
+		size_t stride = pattern::isomorphism * feature.size();
+		if (path_index.size() < path.size() * stride) path_index.resize(path.size() * stride);
+		for (size_t i = 0; i < path.size(); i++)
+			feature_indices(path.after(i), path_index.data() + i * stride);
+		auto idx = [&](size_t i) { return path_index.data() + i * stride; };
+		auto value = [&](size_t i) { tally.estimates++; return unrolled ? layout_4x6::sum(net.data(), idx(i)) : feature_sum(idx(i)); };
+		auto count = [&](float td_error) { tally.td_sum += td_error; tally.td_square += double(td_error) * td_error; return td_error; };
+		bool hashing = std::any_of(feature.begin(), feature.end(), [](const pattern& p) { return p.hashed(); });
+
 		float tmp = 0;	//zero for the final afterstate
-		float alpha_final = alpha / 32;
-		adjust_value(path[path.size()-1].board_after, alpha / 32 * ( tmp - estimate_value(path[path.size()-1].board_after)));
-		// tmp = path[path.size()-1].reward + estimate_value(path[path.size()-1].board_after);
+		float alpha_final = alpha / (pattern::isomorphism * feature.size());
+		if (hashing) record_collisions(path.after(path.size()-1));
+		adjust_indices(idx(path.size()-1), alpha_final, count(tmp - value(path.size()-1)));
+		board::reward total_reward = 0;	//the rewards of path[i+1..i+n_step]
+		float lambda_return = 0;	//the lambda-return of path[i+1]
 		for (int i = path.size() - 2; i >= 0; i--) {
-			board::reward total_reward = 0;
-			for(int j = 1; j <= n_step; j++){
-				if(i + j >= int(path.size())) break;
-				total_reward += path[i+j].reward;
+			if (i >= int(prefetch_distance)) prefetch(idx(i - prefetch_distance));
+			total_reward += path[i+1].reward;
+			if (i + 1 + n_step < int(path.size())) total_reward -= path[i+1+n_step].reward;
+
+			if (lambda > 0) {
+				tmp = lambda_return = path[i+1].reward + (1 - lambda) * value(i+1) + lambda * lambda_return;
 			}
-			
-			if(i + n_step >= int(path.size())){
+			else if(i + n_step >= int(path.size())){
 				tmp = total_reward;
 			}
 			else{
-				tmp = total_reward + estimate_value(path[i+n_step].board_after);
+				tmp = total_reward + value(i+n_step);
 			}
-			float td_error = tmp -  estimate_value(path[i].board_after);
-			adjust_value(path[i].board_after, alpha_final * td_error);
+			float td_error = count(tmp -  value(i));
+			if (hashing) record_collisions(path.after(i));
+			adjust_indices(idx(i), alpha_final, td_error);
 		}
+		tally.updates += path.size();
+		if (cache && alpha != 0) cache->advance();
+		if (sync_every && ++sync_count % sync_every == 0) synchronize();
+		mark = std::chrono::steady_clock::now();
+		tally.learn += std::chrono::duration<double>(mark - start).count();
+		flush();
+	}
+
+private:
+	/**
+	 * add the tally into the shared counters, once per episode
+	 * the time since 'mark', the end of the last update or episode, is counted as play time
+	 */
+	void flush() {
+		if (cache) cache->merge(cache_count);
+		counters->add(tally);
+		tally = telemetry::tally();
 	}
 
 private:
 	std::array<int, 4> opcode;
 	std::vector<int> space;
+	bool unrolled = false;
+	bool vectorized = false;
+	bool quantized = false;
+	avx2_network simd;
+	mutable std::vector<uint32_t> index_buffer;
+	std::vector<uint32_t> path_index;
+	std::vector<decision> decisions;
+	std::vector<bitboard> batch_after;
+	std::vector<float> batch_value;
+	int depth = 1;
+	frontier probe;
+	frontier missed;
+	uint8_t missed_at[64];
+	std::shared_ptr<transposition> cache;
+	transposition::counters cache_count;
+	bool cache_leaves = false;
+	bool snapshot_bound = false; // a copy bound to a snapshot, whose table and counters are not reported
+	double budget = 0;
+	double game_budget = 0;
+	double game_spent = 0;
+	size_t game_moves = 0;
+	size_t games_played = 0;
+	size_t moves_played = 0;
+	std::chrono::steady_clock::time_point deadline;
+	bool timing = false;
+	bool timed_out = false;
+	unsigned ticks = 0;
+
+	/**
+	 * the threads of a split search, and the helper sliders of all threads but the caller
+	 */
+	struct splitter {
+		thread_pool pool;
+		std::vector<std::unique_ptr<learning_slider>> helper;
+		splitter(unsigned threads) : pool(threads) {}
+	};
+	std::shared_ptr<splitter> split;
+	std::shared_ptr<telemetry> counters = std::make_shared<telemetry>();
+	telemetry::tally tally;
+	std::chrono::steady_clock::time_point mark = std::chrono::steady_clock::now();
+	static constexpr size_t prefetch_distance = 4;
+	/**
+	 * the cells where the next tile enters after each move, i.e., the side opposite to the slide
+	 */
+	static constexpr int spaces[4][4] = { { 12, 13, 14, 15 }, { 0, 4, 8, 12 }, { 0, 1, 2, 3 }, { 3, 7, 11, 15 } };
 };
+constexpr size_t learning_slider::prefetch_distance;
+constexpr int learning_slider::spaces[4][4];
 
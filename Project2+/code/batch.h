@@ -0,0 +1,169 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * batch.h: Batch environment that plays many games in lockstep
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "board.h"
+#include "bitboard.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "eval.h"
+
+/**
+ * a batch environment that plays many games of Threes! in lockstep
+ *
+ * the boards of all games are held as arrays of their tiles and attributes, and every tick
+ * advances all games together: the placer places tiles on the boards whose turn it is, then
+ * the slider selects the moves of all boards at once, so that the afterstates below the
+ * candidates of every game are evaluated (and prefetched) as a single batch
+ *
+ * a finished game is recorded into the statistics, trained on, and restarted in place
+ * with batch size 1, the games are played exactly as by the loop in main()
+ */
+class batch_env {
+public:
+	batch_env(size_t size, learning_slider& slide, random_placer& place, evaluator* judge = nullptr) : size(size), slide(slide), place(place), judge(judge),
+		tile(size), attr(size), active(size, false), carry(size, 0), path(size), game(size) {
+		if (size > 1 && slide.game_timed()) {
+			std::cerr << "game_budget is kept per game, and the games of --batch=" << size << " overlap" << std::endl;
+			std::exit(-1);
+		}
+	}
+
+	/**
+	 * play games until the statistics hold 'total' episodes
+	 */
+	void run(statistics& stats, size_t total) {
+		next = stats.step();
+		live = 0;
+		for (size_t g = 0; g < size && next < total; g++, next++) start(g, stats);
+		std::vector<bitboard> before;
+		std::vector<size_t> which;
+		std::vector<action> move;
+		std::vector<float> value;
+		std::vector<int> reward;
+		while (live) {
+			for (size_t g = 0; g < size; g++) {
+				while (active[g] && !slide_turn(g)) {
+					auto clock = std::chrono::steady_clock::now();
+					bitboard b(tile[g], attr[g]);
+					action move = place.take_action(b);
+					action::place p = move;
+					board::reward r = move.type() == action::place::type ? b.place(p.position(), p.tile(), p.hint()) : -1;
+					if (r == -1) {
+						finish(g, stats, total);
+						continue;
+					}
+					tile[g] = b.cells();
+					attr[g] = b.info();
+					int64_t nsec = since(clock);
+					stats.elapse(1, 1, nsec);
+					game[g].record(move, r, spend(g, nsec));
+				}
+			}
+
+			before.clear();
+			which.clear();
+			for (size_t g = 0; g < size; g++) {
+				if (!active[g]) continue;
+				before.emplace_back(tile[g], attr[g]);
+				which.push_back(g);
+			}
+			size_t n = which.size();
+			move.assign(n, action());
+			value.assign(n, 0.0f);
+			reward.assign(n, 0);
+			auto clock = std::chrono::steady_clock::now();
+			slide.take_actions(before.data(), n, move.data(), value.data(), reward.data());
+			int64_t spent = since(clock), nsec = n ? spent / n : 0;
+			stats.elapse(0, n, spent);
+			for (size_t i = 0; i < n; i++) {
+				size_t g = which[i];
+				bitboard b = before[i];
+				board::reward r = move[i].type() == action::slide::type ? b.slide(move[i].event()) : -1;
+				if (r == -1) {
+					finish(g, stats, total);
+					continue;
+				}
+				tile[g] = b.cells();
+				attr[g] = b.info();
+				game[g].record(move[i], r, spend(g, nsec));
+				if (reward[i] != 0 || value[i] != 0) {
+					path[g].push(b, reward[i], value[i]);		//store afterstate value to calculate td error
+				}
+			}
+		}
+	}
+
+private:
+	bool slide_turn(size_t g) const {
+		size_t step = game[g].step();
+		return step >= 9 && (step - 8) % 2;
+	}
+
+	void start(size_t g, const statistics& stats) {
+		bitboard b;
+		tile[g] = b.cells();
+		attr[g] = b.info();
+		slide.open_episode("~:" + place.name());
+		place.open_episode(slide.name() + ":~");
+		game[g] = stats.new_episode();
+		game[g].open_episode(slide.name() + ":" + place.name());
+		path[g].clear();
+		carry[g] = 0;
+		active[g] = true;
+		live++;
+	}
+
+	void finish(size_t g, statistics& stats, size_t total) {
+		game[g].state() = bitboard(tile[g], attr[g]);
+		agent& win = game[g].last_turns(slide, place);
+		game[g].close_episode(win.name());
+		stats.append(std::move(game[g]));
+		slide.update(path[g]);
+		if (judge) judge->offer(slide.weights(), stats.step());
+		slide.close_episode(win.name());
+		place.close_episode(win.name());
+		active[g] = false;
+		live--;
+		if (next < total) start(g, stats), next++;
+	}
+
+	/**
+	 * the time of a move in milliseconds, where the moves of the slider share the time of
+	 * their batch evenly, and the remainders are carried so that the total of a game stays accurate
+	 */
+	time_t spend(size_t g, int64_t nsec) {
+		carry[g] += nsec;
+		time_t msec = carry[g] / 1000000;
+		carry[g] %= 1000000;
+		return msec;
+	}
+	static int64_t since(std::chrono::steady_clock::time_point clock) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clock).count();
+	}
+
+private:
+	size_t size;
+	learning_slider& slide;
+	random_placer& place;
+	evaluator* judge;
+	std::vector<bitboard::raw> tile;
+	std::vector<bitboard::data> attr;
+	std::vector<bool> active;
+	std::vector<int64_t> carry;
+	std::vector<trajectory> path;
+	std::vector<episode> game;
+	size_t next = 0;
+	size_t live = 0;
+};
@@ -0,0 +1,252 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * bitboard.h: Define the packed 64-bit game state of the game of Threes!
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include "board.h"
+
+/**
+ * bitboard for Threes!, 4 bits per cell in a single 64-bit word
+ *
+ * cell (i) is stored at bits [4i, 4i+4), so row (r) occupies bits [16r, 16r+16)
+ * slides are resolved by looking up each row (or column) in precomputed tables,
+ * which hold the resulting row and the reward for all 65536 possible rows
+ *
+ * the attribute word (hint, last action, and bag) shares its layout with board,
+ * so the two representations can be converted back and forth freely
+ */
+class bitboard {
+public:
+	typedef board::cell cell;
+	typedef board::data data;
+	typedef board::score score;
+	typedef board::reward reward;
+	typedef uint64_t raw;
+
+public:
+	bitboard() : tile(0), attr(0) { reset(); }
+	bitboard(raw x, data v) : tile(x), attr(v) {}
+	bitboard(const board& b) : tile(0), attr(b.info()) {
+		for (int i = 0; i < 16; i++) tile |= raw(b(i)) << (4 * i);
+	}
+	bitboard(const bitboard& b) = default;
+	bitboard& operator =(const bitboard& b) = default;
+
+	operator board() const {
+		board b(board::grid(), attr);
+		for (int i = 0; i < 16; i++) b(i) = at(i);
+		return b;
+	}
+
+	cell at(unsigned i) const { return (tile >> (4 * i)) & 0x0fu; }
+	void set(unsigned i, cell t) { tile = (tile & ~(raw(0x0fu) << (4 * i))) | (raw(t & 0x0fu) << (4 * i)); }
+	cell operator ()(unsigned i) const { return at(i); }
+
+	raw cells() const { return tile; }
+	raw cells(raw x) { raw old = tile; tile = x; return old; }
+
+	data info() const { return attr; }
+	data info(data dat) { data old = attr; attr = dat; return old; }
+
+private:
+	data info4(size_t i) const { return (info() >> (4 * i)) & 0x0fu; }
+	data info4(size_t i, data dat) { data old = info4(i); info(info() ^ ((old ^ dat) << (4 * i))); return old; }
+
+public:
+	cell hint() const { return info4(0); }
+	cell hint(cell t) { return info4(0, t); }
+	unsigned last() const { return info4(1); }
+	unsigned last(unsigned a) { return info4(1, a); }
+	unsigned bag(cell t) const { return info4(t + 1); }
+	unsigned bag(cell t, unsigned n) { return info4(t + 1, n); }
+
+	void reset() {
+		hint(0);
+		last(4);
+		reset_bag();
+	}
+	void reset_bag() {
+		for (cell t = 1; t <= 3; t++) bag(t, 1);
+	}
+	bool extract_hint_from_bag(cell t) {
+		if (bag(t) < 1) return false;
+		bag(t, bag(t) - 1);
+		if (bag(1) + bag(2) + bag(3) == 0) reset_bag();
+		hint(t);
+		return true;
+	}
+	unsigned value() const {
+		score v = 0;
+		for (int i = 0; i < 16; i++) v += board::itov(at(i));
+		return v;
+	}
+	cell max_tile() const {
+		cell m = 0;
+		for (int i = 0; i < 16; i++) m = std::max(m, at(i));
+		return m;
+	}
+
+public:
+	bool operator ==(const bitboard& b) const { return tile == b.tile; }
+	bool operator < (const bitboard& b) const { return tile <  b.tile; }
+	bool operator !=(const bitboard& b) const { return !(*this == b); }
+
+public:
+
+	/**
+	 * place a tile (index value) to the specific position (1-d index)
+	 * return >= 0 if the action is valid, or -1 if not
+	 */
+	reward place(unsigned pos, cell tile, cell hint_tile) {
+		data bak = info();
+		if (pos >= 16 || at(pos)) return -1;
+		if (hint() == 0 && !extract_hint_from_bag(tile)) return -1;
+		if (hint() != tile) return info(bak), -1;
+		if (!extract_hint_from_bag(hint_tile)) return info(bak), -1;
+		set(pos, tile);
+		last(4);
+		return board::itov(tile);
+	}
+
+	/**
+	 * apply an action to the board
+	 * return the reward of the action, or -1 if the action is illegal
+	 */
+	reward slide(unsigned opcode) {
+		reward r = -1;
+		switch (opcode & 0b11) {
+		case 0: r = slide_up(); break;
+		case 1: r = slide_right(); break;
+		case 2: r = slide_down(); break;
+		case 3: r = slide_left(); break;
+		}
+		if (r != -1) last(opcode & 0b11);
+		return r;
+	}
+
+	reward slide_left() { return slide_rows(lookup::find().left); }
+	reward slide_right() { return slide_rows(lookup::find().right); }
+	reward slide_up() { return slide_cols(lookup::find().left); }
+	reward slide_down() { return slide_cols(lookup::find().right); }
+
+	void rotate_clockwise() { transpose(); reflect_horizontal(); }
+	void rotate_counterclockwise() { transpose(); reflect_vertical(); }
+	void reverse() { reflect_horizontal(); reflect_vertical(); }
+
+	void reflect_horizontal() {
+		tile = ((tile & 0x000f000f000f000full) << 12) | ((tile & 0x00f000f000f000f0ull) << 4)
+		     | ((tile & 0x0f000f000f000f00ull) >> 4) | ((tile & 0xf000f000f000f000ull) >> 12);
+	}
+	void reflect_vertical() {
+		tile = ((tile & 0x000000000000ffffull) << 48) | ((tile & 0x00000000ffff0000ull) << 16)
+		     | ((tile & 0x0000ffff00000000ull) >> 16) | ((tile & 0xffff000000000000ull) >> 48);
+	}
+	void transpose() {
+		raw a1 = tile & 0xf0f00f0ff0f00f0full;
+		raw a2 = tile & 0x0000f0f00000f0f0ull;
+		raw a3 = tile & 0x0f0f00000f0f0000ull;
+		raw a = a1 | (a2 << 12) | (a3 >> 12);
+		raw b1 = a & 0xff00ff0000ff00ffull;
+		raw b2 = a & 0x00ff00ff00000000ull;
+		raw b3 = a & 0x00000000ff00ff00ull;
+		tile = b1 | (b2 >> 24) | (b3 << 24);
+	}
+
+private:
+
+	/**
+	 * slide lookup tables, indexed by a row of 4 cells packed in 16 bits
+	 * each entry holds the resulting row and the reward of the row
+	 *
+	 * left: slide toward cell 0 of the row, i.e., the left (or up) direction
+	 * right: slide toward cell 3 of the row, i.e., the right (or down) direction
+	 * column: spread a 16-bit row into a column of 4 cells in the 64-bit word
+	 */
+	struct lookup {
+		struct entry {
+			uint16_t row;
+			reward score;
+		};
+		std::array<entry, 65536> left;
+		std::array<entry, 65536> right;
+		std::array<raw, 65536> column;
+
+		lookup() {
+			for (uint32_t r = 0; r < 65536; r++) {
+				std::array<cell, 4> row = {{ r & 0x0fu, (r >> 4) & 0x0fu, (r >> 8) & 0x0fu, (r >> 12) & 0x0fu }};
+				left[r] = slide_left(row);
+				std::swap(row[0], row[3]);
+				std::swap(row[1], row[2]);
+				entry e = slide_left(row);
+				e.row = ((e.row & 0x000fu) << 12) | ((e.row & 0x00f0u) << 4) | ((e.row & 0x0f00u) >> 4) | ((e.row & 0xf000u) >> 12);
+				right[r] = e;
+				column[r] = raw(r & 0x0fu) | (raw((r >> 4) & 0x0fu) << 16) | (raw((r >> 8) & 0x0fu) << 32) | (raw((r >> 12) & 0x0fu) << 48);
+			}
+		}
+
+		/**
+		 * the same slide rule as board::slide_left, applied on a single row
+		 */
+		static entry slide_left(std::array<cell, 4> row) {
+			reward score = 0;
+			for (int c = 1; c < 4; c++) {
+				auto& t0 = row[c - 1];
+				auto& t1 = row[c];
+				if (t0 == 0) {
+					t0 = t1;
+					t1 = 0;
+				} else if (t1 != 0 && ((t0 + t1 == 3) || (t0 == t1 && t0 >= 3 && t0 < 14))) {
+					t0 = std::max(t0, t1) + 1;
+					t1 = 0;
+					score += board::itov(t0) - board::itov(t0 - 1) * 2;
+				}
+			}
+			return { uint16_t(row[0] | (row[1] << 4) | (row[2] << 8) | (row[3] << 12)), score };
+		}
+
+		static const lookup& find() { static const lookup t; return t; }
+	};
+
+	reward slide_rows(const std::array<lookup::entry, 65536>& table) {
+		raw next = 0;
+		reward score = 0;
+		for (int r = 0; r < 4; r++) {
+			const lookup::entry& e = table[(tile >> (16 * r)) & 0xffffu];
+			next |= raw(e.row) << (16 * r);
+			score += e.score;
+		}
+		if (next == tile) return -1;
+		tile = next;
+		return score;
+	}
+	reward slide_cols(const std::array<lookup::entry, 65536>& table) {
+		const lookup& t = lookup::find();
+		raw next = 0;
+		reward score = 0;
+		for (int c = 0; c < 4; c++) {
+			raw col = (tile >> (4 * c)) & 0x000f000f000f000full;
+			const lookup::entry& e = table[(col | (col >> 12) | (col >> 24) | (col >> 36)) & 0xffffu];
+			next |= t.column[e.row] << (4 * c);
+			score += e.score;
+		}
+		if (next == tile) return -1;
+		tile = next;
+		return score;
+	}
+
+public:
+	friend std::ostream& operator <<(std::ostream& out, const bitboard& b) {
+		return out << board(b);
+	}
+
+private:
+	raw tile;
+	data attr; // same layout as board::attr
+};
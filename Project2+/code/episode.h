@@ -19,9 +19,17 @@
 #include "action.h"
 #include "agent.h"
 
+/**
+ * an episode, which records every move with its reward and time
+ * a lean episode keeps only the aggregates (score, final state, step count, and duration),
+ * reading the clock only when the episode is opened and closed
+ *
+ * the moves are stored compactly (see move), so an episode takes about 2 bytes per move,
+ * and the storage grows on demand and is trimmed when the episode is closed
+ */
 class episode {
 public:
-	episode() : ep_state(initial_state()), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
+	episode(bool lean = false) : ep_state(initial_state()), ep_score(0), ep_steps(0), ep_time(0), ep_lean(lean) {}
 
 public:
 	board& state() { return ep_state; }
@@ -33,16 +41,28 @@ public:
 	}
 	void close_episode(const std::string& tag) {
 		ep_close = { tag, millisec() };
+		ep_moves.shrink_to_fit();
+		ep_times.shrink_to_fit();
 	}
 	bool apply_action(action move) {
 		board::reward reward = move.apply(state());
 		if (reward == -1) return false;
-		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		if (!ep_lean) push(move, millisec() - ep_time);
 		ep_score += reward;
+		ep_steps++;
 		return true;
 	}
+	/**
+	 * record a move that was applied elsewhere, e.g., by a batch environment
+	 * the final state of the episode should then be set by state()
+	 */
+	void record(action move, board::reward reward, time_t time) {
+		if (!ep_lean) push(move, time);
+		ep_score += reward;
+		ep_steps++;
+	}
 	agent& take_turns(agent& slide, agent& place) {
-		ep_time = millisec();
+		if (!ep_lean) ep_time = millisec();
 		return step() >= 9 && (step() - 8) % 2 ? slide : place;
 	}
 	agent& last_turns(agent& slide, agent& place) {
@@ -51,7 +71,7 @@ public:
 
 public:
 	size_t step(unsigned who = -1u) const {
-		size_t size = ep_moves.size();
+		size_t size = ep_steps;
 		switch (who) {
 		case action::slide::type: return size > 9 ? (size) / 2 - 4 : 0;
 		case action::place::type: return size > 9 ? (size - 1) / 2 + 5 : size;
@@ -59,16 +79,18 @@ public:
 		}
 	}
 
+	/**
+	 * the time spent by the given agent, or the duration of the episode
+	 * a lean episode has no time per move, so its duration is given for both agents
+	 */
 	time_t time(unsigned who = -1u) const {
 		time_t time = 0;
-		size_t i = 9;
+		if (ep_lean) who = -1u;
 		switch (who) {
 		case action::place::type:
-			if (ep_moves.size())
-				for (i = 0; i < 8; i++) time += ep_moves[i].time;
-			// no break;
 		case action::slide::type:
-			while (i < ep_moves.size()) time += ep_moves[i].time, i += 2;
+			for (const timing& t : ep_times)
+				if (by(who, t.at)) time += t.time;
 			break;
 		default:
 			time = ep_close.when - ep_open.when;
@@ -79,27 +101,27 @@ public:
 
 	std::vector<action> actions(unsigned who = -1u) const {
 		std::vector<action> res;
-		size_t i = 9;
-		switch (who) {
-		case action::place::type:
-			if (ep_moves.size())
-				for (i = 0; i < 8; i++) res.push_back(ep_moves[i]);
-			// no break;
-		case action::slide::type:
-			while (i < ep_moves.size()) res.push_back(ep_moves[i]), i += 2;
-			break;
-		default:
-			res.assign(ep_moves.begin(), ep_moves.end());
-			break;
-		}
+		for (size_t i = 0; i < ep_moves.size(); i++)
+			if (who == -1u || by(who, i)) res.push_back(ep_moves[i]);
 		return res;
 	}
 
 public:
 
+	/**
+	 * the rewards are given back by replaying the moves from the initial state
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
 		out << ep.ep_open << '|';
-		for (const move& mv : ep.ep_moves) out << mv;
+		board state = initial_state();
+		auto t = ep.ep_times.begin();
+		for (size_t i = 0; i < ep.ep_moves.size(); i++) {
+			action code = ep.ep_moves[i];
+			board::reward reward = code.apply(state);
+			out << code;
+			if (reward) out << '[' << std::dec << reward << ']';
+			if (t != ep.ep_times.end() && t->at == i) out << '(' << std::dec << (t++)->time << ')';
+		}
 		out << '|' << ep.ep_close;
 		return out;
 	}
@@ -110,9 +132,23 @@ public:
 		std::stringstream(token) >> ep.ep_open;
 		std::getline(in, token, '|');
 		for (std::stringstream moves(token); !moves.eof(); moves.peek()) {
-			ep.ep_moves.emplace_back();
-			moves >> ep.ep_moves.back();
-			ep.ep_score += action(ep.ep_moves.back()).apply(ep.ep_state);
+			action code;
+			board::reward reward = 0;
+			time_t time = 0;
+			moves >> code;
+			if (moves.peek() == '[') {
+				moves.ignore(1);
+				moves >> std::dec >> reward;
+				moves.ignore(1);
+			}
+			if (moves.peek() == '(') {
+				moves.ignore(1);
+				moves >> std::dec >> time;
+				moves.ignore(1);
+			}
+			ep.push(code, time);
+			ep.ep_score += code.apply(ep.ep_state);
+			ep.ep_steps++;
 		}
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_close;
@@ -121,36 +157,38 @@ public:
 
 protected:
 
+	/**
+	 * a move in 2 bytes, a slide as 0x8000 | opcode, or a placement as position | tile << 4 | hint << 8
+	 */
 	struct move {
-		action code;
-		board::reward reward;
-		time_t time;
-		move(action code = {}, board::reward reward = 0, time_t time = 0) : code(code), reward(reward), time(time) {}
-
-		operator action() const { return code; }
-		friend std::ostream& operator <<(std::ostream& out, const move& m) {
-			out << m.code;
-			if (m.reward) out << '[' << std::dec << m.reward << ']';
-			if (m.time) out << '(' << std::dec << m.time << ')';
-			return out;
-		}
-		friend std::istream& operator >>(std::istream& in, move& m) {
-			in >> m.code;
-			m.reward = 0;
-			m.time = 0;
-			if (in.peek() == '[') {
-				in.ignore(1);
-				in >> std::dec >> m.reward;
-				in.ignore(1);
-			}
-			if (in.peek() == '(') {
-				in.ignore(1);
-				in >> std::dec >> m.time;
-				in.ignore(1);
-			}
-			return in;
+		uint16_t code;
+		move(action a = {}) : code(a.type() == action::slide::type ? 0x8000u | (a.event() & 0b11) : a.event() & 0x0fffu) {}
+
+		operator action() const {
+			action::place p(code & 0x0fu, (code >> 4) & 0x0fu, (code >> 8) & 0x0fu);
+			return code & 0x8000u ? action(action::slide(code & 0b11)) : action(p);
 		}
 	};
+	/**
+	 * the time of a move in milliseconds, kept only for the moves that took any
+	 */
+	struct timing {
+		uint32_t at;
+		uint32_t time;
+	};
+
+	void push(action code, time_t time) {
+		if (time) ep_times.push_back({ uint32_t(ep_moves.size()), uint32_t(time) });
+		ep_moves.emplace_back(code);
+	}
+	/**
+	 * whether the i-th move is made by the given agent, where the first 9 moves are placements,
+	 * and the agents take turns from then on
+	 */
+	static bool by(unsigned who, size_t i) {
+		bool place = i < 9 || (i - 9) % 2;
+		return who == action::place::type ? place : !place;
+	}
 
 	struct meta {
 		std::string tag;
@@ -177,7 +215,10 @@ private:
 	board ep_state;
 	board::score ep_score;
 	std::vector<move> ep_moves;
+	std::vector<timing> ep_times;
+	size_t ep_steps;
 	time_t ep_time;
+	bool ep_lean;
 
 	meta ep_open;
 	meta ep_close;
@@ -0,0 +1,165 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * eval.h: Background evaluation of the weight tables during training
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "pipeline.h"
+
+/**
+ * an evaluator that plays a fixed set of games with a snapshot of the weight tables,
+ * on a thread of its own, so that the playing strength is measured while training
+ *
+ * the trainer offers the weight tables every 'period' episodes, and a copy of them is taken
+ * into a snapshot only if the evaluator is idle, so the trainer pays no more than that copy
+ * every round plays the same games, since its placer restarts from the same seed
+ *
+ * a round is reported as
+ * eval: 3000, avg = 7012, max = 27063, 1536 = 63.5%, 3072 = 12%, 6144 = 0%, ops = 412345
+ * where '3000' is the episode at which the snapshot was taken, and the tile rates are
+ * the percentages of the games that reached at least that tile
+ */
+class evaluator {
+public:
+	evaluator(const learning_slider& slide, const std::string& place_args, size_t games, size_t period) :
+		slide(slide.snapshot_worker(0)), place(place_args + " seed=" + std::to_string(seed)),
+		snap(slide.weights(), slide.page()), games(games), period(period), due(0), pending(false), busy(false), stop(false) {
+		this->slide.detach_meter();
+		thread = std::thread(&evaluator::run, this);
+	}
+	evaluator(const evaluator&) = delete;
+	evaluator& operator =(const evaluator&) = delete;
+
+	/**
+	 * finish the pending round (if any), then stop the thread
+	 */
+	~evaluator() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		ready.notify_one();
+		thread.join();
+	}
+
+	/**
+	 * offer the weight tables after 'episode' episodes are learned
+	 * the tables are copied only every 'period' episodes, and only when the evaluator is idle
+	 */
+	void offer(const std::vector<weight>& net, size_t episode) {
+		if (episode % period) return;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (pending || busy || !snap.publish(net)) return;
+			due = episode;
+			pending = true;
+		}
+		ready.notify_one();
+	}
+
+private:
+	void run() {
+		while (true) {
+			size_t at;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				ready.wait(guard, [this]() { return pending || stop; });
+				if (!pending) return;
+				at = due;
+				pending = false;
+				busy = true;
+			}
+			unsigned buffer = snap.acquire();
+			slide.bind(snap.tables(buffer));
+			report(at, benchmark());
+			snap.release(buffer);
+			std::lock_guard<std::mutex> guard(lock);
+			busy = false;
+		}
+	}
+
+	struct result {
+		board::score sum = 0, max = 0;
+		size_t reach[3] = { 0, 0, 0 }; // 1536, 3072, 6144
+		size_t moves = 0;
+		double sec = 0;
+	};
+
+	/**
+	 * play the fixed set of games greedily, without learning
+	 */
+	result benchmark() {
+		result res;
+		random_placer bench = place;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < games; i++) {
+			episode game(true);
+			slide.open_episode("~:" + bench.name());
+			bench.open_episode(slide.name() + ":~");
+			game.open_episode(slide.name() + ":" + bench.name());
+			while (true) {
+				float state_value = 0.0;
+				int reward = 0;
+				agent& who = game.take_turns(slide, bench);
+				action move = who.take_action(game.state(), state_value, reward);
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+			}
+			agent& win = game.last_turns(slide, bench);
+			game.close_episode(win.name());
+			slide.close_episode(win.name());
+			bench.close_episode(win.name());
+			board::cell tile = *std::max_element(game.state().begin(), game.state().end());
+			res.sum += game.score();
+			res.max = std::max(res.max, game.score());
+			for (unsigned t = 0; t < 3; t++) res.reach[t] += board::itot(tile) >= (1536u << t);
+			res.moves += game.step();
+		}
+		res.sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return res;
+	}
+
+	void report(size_t at, const result& res) const {
+		std::stringstream out;
+		out << std::fixed << std::setprecision(0);
+		out << "eval: " << at << ", avg = " << (res.sum / std::max<size_t>(games, 1)) << ", max = " << res.max;
+		out << std::setprecision(1);
+		for (unsigned t = 0; t < 3; t++)
+			out << ", " << (1536u << t) << " = " << (res.reach[t] * 100.0 / std::max<size_t>(games, 1)) << "%";
+		out << std::setprecision(0);
+		out << ", ops = " << (res.sec > 0 ? res.moves / res.sec : 0) << std::endl;
+		std::cout << out.str() << std::flush;
+	}
+
+private:
+	static constexpr unsigned seed = 2022;
+	learning_slider slide;
+	random_placer place;
+	snapshot snap;
+	size_t games;
+	size_t period;
+	size_t due;
+	bool pending;
+	bool busy;
+	bool stop;
+	std::mutex lock;
+	std::condition_variable ready;
+	std::thread thread;
+};
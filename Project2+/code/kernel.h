@@ -0,0 +1,119 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * kernel.h: Unrolled evaluation kernels for n-tuple networks of fixed layouts
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "bitboard.h"
+#include "pattern.h"
+#include "weight.h"
+
+/**
+ * the cell positions of a tuple, given as compile-time constants
+ */
+template<unsigned... cells>
+struct tuple_cells {
+	static constexpr unsigned length = sizeof...(cells);
+
+	static bool matches(const pattern& p) {
+		const unsigned pos[] = { cells... };
+		return !p.hashed() && p.cells() == std::vector<unsigned>(pos, pos + length);
+	}
+
+	/**
+	 * the feature index of the given isomorphism, with all positions resolved at compile time
+	 */
+	template<unsigned iso>
+	static uint32_t index(bitboard::raw x) {
+		return digits<iso, cells...>::of(x, 0);
+	}
+
+private:
+	template<unsigned iso, unsigned... rest> struct digits {
+		static uint32_t of(bitboard::raw x, uint32_t idx) { return idx; }
+	};
+	template<unsigned iso, unsigned p, unsigned... rest> struct digits<iso, p, rest...> {
+		static uint32_t of(bitboard::raw x, uint32_t idx) {
+			return digits<iso, rest...>::of(x, (idx << 4) | uint32_t((x >> (4 * pattern::isomorphic(iso, p))) & 0x0fu));
+		}
+	};
+};
+
+/**
+ * an n-tuple network layout whose tuples are all known at compile time
+ *
+ * the compiler unrolls every isomorphism of every tuple into straight-line index
+ * computation and table loads, which are summed in the same order as the runtime
+ * path of learning_slider, so both paths give bit-identical values
+ */
+template<typename... tuples>
+struct layout {
+	static constexpr unsigned size = sizeof...(tuples);
+
+	static bool matches(const std::vector<pattern>& feature) {
+		if (feature.size() != size) return false;
+		size_t k = 0;
+		const bool match[] = { tuples::matches(feature[k++])... };
+		return std::all_of(match, match + size, [](bool m) { return m; });
+	}
+
+	static float estimate(const weight* net, bitboard::raw x) {
+		return accumulate<0>::sum(net, x, 0.0f);
+	}
+
+	/**
+	 * the feature indices of all isomorphisms, stored as idx[iso * size + tuple]
+	 */
+	static void indices(bitboard::raw x, uint32_t* idx) {
+		accumulate<0>::indices(x, idx);
+	}
+
+	/**
+	 * the value from the feature indices given by indices()
+	 */
+	static float sum(const weight* net, const uint32_t* idx) {
+		float sum = 0.0f;
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++, idx += size) {
+			float part = net[0][idx[0]];
+			for (unsigned k = 1; k < size; k++) part += net[k][idx[k]];
+			sum += part;
+		}
+		return sum;
+	}
+
+private:
+	template<unsigned iso, bool done = (iso == pattern::isomorphism)> struct accumulate {
+		static float sum(const weight* net, bitboard::raw x, float sum) {
+			const uint32_t idx[] = { tuples::template index<iso>(x)... };
+			float part = net[0][idx[0]];
+			for (unsigned k = 1; k < size; k++) part += net[k][idx[k]];
+			return accumulate<iso + 1>::sum(net, x, sum + part);
+		}
+		static void indices(bitboard::raw x, uint32_t* idx) {
+			const uint32_t part[] = { tuples::template index<iso>(x)... };
+			std::copy(part, part + size, idx);
+			accumulate<iso + 1>::indices(x, idx + size);
+		}
+	};
+	template<unsigned iso> struct accumulate<iso, true> {
+		static float sum(const weight* net, bitboard::raw x, float sum) { return sum; }
+		static void indices(bitboard::raw x, uint32_t* idx) {}
+	};
+};
+
+/**
+ * the default 4x6-tuple network
+ */
+typedef layout<
+	tuple_cells<0, 1, 2, 3, 4, 5>,
+	tuple_cells<4, 5, 6, 7, 8, 9>,
+	tuple_cells<5, 6, 7, 9, 10, 11>,
+	tuple_cells<9, 10, 11, 13, 14, 15>
+> layout_4x6;
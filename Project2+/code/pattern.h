@@ -0,0 +1,225 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * pattern.h: Define the n-tuple patterns and their isomorphic feature indices
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include "bitboard.h"
+
+/**
+ * n-tuple pattern for the n-tuple network
+ *
+ * the cell positions of the tuple under all 8 symmetries of the board are built
+ * once at construction, so that the feature index of every isomorphism can be read
+ * straight from the untouched board without copying or rotating it
+ *
+ * the isomorphisms are ordered as
+ * (0-3) the board rotated clockwise 0-3 times
+ * (4-7) the board reflected horizontally, then rotated clockwise 0-3 times
+ *
+ * the index encodes the first cell of the tuple as the most significant digit, e.g.,
+ * tuple (0, 1, 2, 3, 4, 5) gives b(0) * 16^5 + b(1) * 16^4 + ... + b(5)
+ *
+ * a tuple may be hashed into a table of 2^bits slots instead of the dense 16^length,
+ * so that long tuples fit a fixed memory budget at the cost of some collisions
+ */
+class pattern {
+public:
+	static constexpr unsigned isomorphism = 8;
+	static constexpr unsigned max_length = 8;
+
+	/**
+	 * the words a feature index is read from, computed once per evaluation
+	 *
+	 * (0) the board as-is, where a run of cells going backward is a contiguous segment
+	 * (1) the board with its nibbles reversed, where a run going forward is contiguous
+	 * (2) the transposed board, where a run going up a column is contiguous
+	 * (3) the transposed board reversed, where a run going down a column is contiguous
+	 */
+	struct view {
+		bitboard::raw word[4];
+		view(bitboard::raw x) {
+			bitboard t(x, 0);
+			t.transpose();
+			word[0] = x;
+			word[1] = reverse(x);
+			word[2] = t.cells();
+			word[3] = reverse(t.cells());
+		}
+		static bitboard::raw reverse(bitboard::raw x) {
+			x = __builtin_bswap64(x);
+			return ((x & 0x0f0f0f0f0f0f0f0full) << 4) | ((x & 0xf0f0f0f0f0f0f0f0ull) >> 4);
+		}
+	};
+
+public:
+	pattern() : pattern(std::vector<unsigned>()) {}
+	pattern(const std::vector<unsigned>& cells, unsigned bits = 0) : tuple(cells), segs(), num(0), bits(bits) {
+		for (unsigned s = 0; s < isomorphism; s++) {
+			std::vector<unsigned> pos;
+			for (unsigned p : tuple) pos.push_back(isomorphic(s, p));
+			compile(pos, s);
+		}
+	}
+
+public:
+	/**
+	 * the original cell that is moved to position (p) by the given isomorphism
+	 */
+	static constexpr unsigned isomorphic(unsigned iso, unsigned p) {
+		return iso >= 4 ? reflected(isomorphic(iso - 4, p)) : iso ? isomorphic(iso - 1, rotated(p)) : p;
+	}
+	static constexpr unsigned rotated(unsigned p) { return (3 - p % 4) * 4 + p / 4; }
+	static constexpr unsigned reflected(unsigned p) { return (p / 4) * 4 + (3 - p % 4); }
+
+	size_t length() const { return tuple.size(); }
+	size_t size() const { return size_t(1) << (bits ? bits : 4 * length()); }
+	bool hashed() const { return bits != 0; }
+	const std::vector<unsigned>& cells() const { return tuple; }
+	std::string name() const {
+		std::string res;
+		for (unsigned p : tuple) res += (res.size() ? "," : "") + std::to_string(p);
+		if (bits) res += "@" + std::to_string(bits);
+		return res;
+	}
+
+	/**
+	 * the feature index of the given isomorphism of the board, i.e., the slot of its key
+	 */
+	uint32_t index(const view& b, unsigned iso) const {
+		return slot(key(b, iso));
+	}
+
+	/**
+	 * the tuple index of the given isomorphism of the board, before hashing
+	 */
+	uint32_t key(const view& b, unsigned iso) const {
+		const segment* sg = segs[iso].data();
+		uint32_t idx = 0;
+		for (unsigned i = 0; i < num; i++)
+			idx = (idx << sg[i].width) | (uint32_t(b.word[sg[i].source] >> sg[i].shift) & sg[i].mask);
+		return idx;
+	}
+
+	/**
+	 * the slot of a tuple index, by Fibonacci hashing if the tuple is hashed
+	 * and a nonzero 7-bit tag of the index taken from the bits below the slot
+	 */
+	uint32_t slot(uint32_t key) const {
+		return bits ? uint32_t(hash(key) >> (64 - bits)) : key;
+	}
+	uint8_t tag(uint32_t key) const {
+		return uint8_t(hash(key) >> (57 - bits)) | 0x80u;
+	}
+	static uint64_t hash(uint32_t key) { return key * 0x9e3779b97f4a7c15ull; }
+	uint32_t index(bitboard::raw x, unsigned iso) const {
+		return index(view(x), iso);
+	}
+
+	/**
+	 * check the tuple index of every isomorphism against reading the cells one by one,
+	 * on a few pseudo-random boards
+	 */
+	bool verify() const {
+		uint64_t x = 0x9e3779b97f4a7c15ull;
+		for (unsigned n = 0; n < 64; n++) {
+			x = x * 6364136223846793005ull + 1442695040888963407ull;
+			view b(x);
+			for (unsigned iso = 0; iso < isomorphism; iso++) {
+				uint32_t idx = 0;
+				for (unsigned p : tuple) idx = (idx << 4) | uint32_t((x >> (4 * isomorphic(iso, p))) & 0x0fu);
+				if (key(b, iso) != idx) return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * the tuple is stored as its length, with the hash bits (if any) in the upper half,
+	 * followed by its cells
+	 * a tuple read with an invalid length, hash bits, or cell sets the failbit of the stream
+	 */
+	friend std::ostream& operator <<(std::ostream& out, const pattern& p) {
+		uint32_t len = p.tuple.size() | (p.bits << 16);
+		out.write(reinterpret_cast<const char*>(&len), sizeof(uint32_t));
+		for (uint32_t cell : p.tuple) out.write(reinterpret_cast<const char*>(&cell), sizeof(uint32_t));
+		return out;
+	}
+	friend std::istream& operator >>(std::istream& in, pattern& p) {
+		uint32_t len = 0;
+		in.read(reinterpret_cast<char*>(&len), sizeof(uint32_t));
+		unsigned bits = len >> 16;
+		len &= 0xffffu;
+		if (len == 0 || len > max_length || (bits && (bits > 32 || bits >= 4 * len)))
+			return in.setstate(std::ios::failbit), in;
+		std::vector<unsigned> cells(len);
+		for (unsigned& cell : cells) {
+			uint32_t v = 0;
+			in.read(reinterpret_cast<char*>(&v), sizeof(uint32_t));
+			if (v >= 16) return in.setstate(std::ios::failbit), in;
+			cell = v;
+		}
+		p = pattern(cells, bits);
+		return in;
+	}
+
+private:
+	/**
+	 * a contiguous run of cells in one of the view words
+	 * 'shift' locates its least significant cell, and 'width' is its size in bits
+	 * a run has at most 7 cells, so that its width and mask stay below 32 bits
+	 *
+	 * every isomorphism is padded with empty segments (zero width and mask) up to
+	 * the same count, so that the loop in index() has a fixed trip count per tuple
+	 */
+	struct segment {
+		uint8_t source;
+		uint8_t shift;
+		uint8_t width;
+		uint32_t mask;
+	};
+
+	/**
+	 * split the positions of a tuple into the fewest contiguous segments, greedily
+	 */
+	void compile(const std::vector<unsigned>& pos, unsigned iso) {
+		unsigned n = 0;
+		auto t = [](unsigned p) { return (p % 4) * 4 + p / 4; };
+		for (size_t j = 0; j < pos.size(); ) {
+			size_t best = 1;
+			segment seg = { 0, uint8_t(4 * pos[j]), 4, 0x0fu };
+			for (unsigned src = 0; src < 4; src++) {
+				auto at = [&](size_t k) { return int(src < 2 ? pos[k] : t(pos[k])); };
+				int step = (src % 2 == 0) ? -1 : +1;
+				size_t w = 1;
+				while (j + w < pos.size() && w < 7 && at(j + w) == at(j) + step * int(w)) w++;
+				if (w <= best) continue;
+				int low = at(j + w - 1); // the least significant cell of the run
+				best = w;
+				seg.source = src;
+				seg.shift = 4 * (src % 2 == 0 ? low : 15 - low);
+				seg.width = 4 * w;
+				seg.mask = (1u << seg.width) - 1;
+			}
+			segs[iso][n++] = seg;
+			j += best;
+		}
+		num = std::max(num, n);
+	}
+
+private:
+	std::vector<unsigned> tuple;
+	std::array<std::array<segment, max_length>, isomorphism> segs;
+	unsigned num;
+	unsigned bits;
+};
@@ -0,0 +1,161 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * pipeline.h: Lock-free queue and weight snapshots for actor-learner training
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include "weight.h"
+
+/**
+ * a bounded lock-free queue for many producers and a single consumer (Vyukov's bounded queue)
+ *
+ * each cell carries a sequence number telling whether it is free for the producer of a
+ * position or holds the item for the consumer of that position, so producers only contend
+ * on the enqueue position by compare-and-swap, and the consumer never blocks them
+ *
+ * items are swapped in and out of the cells rather than moved, so the buffers they own
+ * circulate between the producers and the consumer instead of being reallocated
+ */
+template<typename type>
+class mpsc_queue {
+public:
+	mpsc_queue(size_t capacity) : cell(round(capacity)), mask(cell.size() - 1), head(0), tail(0) {
+		for (size_t i = 0; i < cell.size(); i++) cell[i].seq.store(i, std::memory_order_relaxed);
+	}
+	mpsc_queue(const mpsc_queue&) = delete;
+	mpsc_queue& operator =(const mpsc_queue&) = delete;
+
+	/**
+	 * swap an item into the queue, or return false if the queue is full
+	 */
+	bool push(type& item) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		node* c;
+		while (true) {
+			c = &cell[pos & mask];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos);
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+		std::swap(c->item, item);
+		c->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * swap the oldest item out of the queue, or return false if the queue is empty
+	 * only a single thread may pop
+	 */
+	bool pop(type& item) {
+		size_t pos = head.load(std::memory_order_relaxed);
+		node& c = cell[pos & mask];
+		if (c.seq.load(std::memory_order_acquire) != pos + 1) return false;
+		std::swap(item, c.item);
+		c.seq.store(pos + mask + 1, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t size() const {
+		size_t tl = tail.load(std::memory_order_acquire), hd = head.load(std::memory_order_acquire);
+		return tl > hd ? tl - hd : 0;
+	}
+	size_t capacity() const { return cell.size(); }
+
+private:
+	static size_t round(size_t n) {
+		size_t size = 2;
+		while (size < n) size <<= 1;
+		return size;
+	}
+
+	struct node {
+		std::atomic<size_t> seq;
+		type item;
+	};
+
+private:
+	std::vector<node> cell;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
+
+/**
+ * double-buffered read-only copies of the weight tables, for the actors of actor-learner training
+ *
+ * the learner writes a new copy into the buffer that is not current, then makes it current,
+ * while the actors keep reading the buffer they acquired at the start of their episodes
+ * a buffer still being read is never overwritten, so publish() is skipped until it is released
+ */
+class snapshot {
+public:
+	snapshot(const std::vector<weight>& net, arena::mode type) : current(0), version(0) {
+		std::vector<size_t> sizes;
+		std::vector<char*> slices;
+		for (const weight& w : net) sizes.push_back(w.size() * sizeof(weight::type));
+		for (unsigned i = 0; i < 2; i++) {
+			mem[i] = arena::carve(sizes, type, slices);
+			for (size_t k = 0; k < net.size(); k++)
+				table[i].emplace_back(reinterpret_cast<weight::type*>(slices[k]), net[k].size());
+			readers[i].store(0);
+		}
+		copy(net, table[0]);
+	}
+
+	/**
+	 * copy the weight tables into the buffer that is not current and make it current,
+	 * or return false if some actor is still reading that buffer
+	 */
+	bool publish(const std::vector<weight>& net) {
+		unsigned back = 1 - current.load();
+		if (readers[back].load() != 0) return false;
+		copy(net, table[back]);
+		current.store(back);
+		version++;
+		return true;
+	}
+
+	/**
+	 * the current buffer, which stays valid until it is released
+	 */
+	unsigned acquire() {
+		while (true) {
+			unsigned i = current.load();
+			readers[i]++;
+			if (current.load() == i) return i;
+			readers[i]--;
+		}
+	}
+	void release(unsigned i) { readers[i]--; }
+	const std::vector<weight>& tables(unsigned i) const { return table[i]; }
+	size_t versions() const { return version.load(); }
+
+private:
+	static void copy(const std::vector<weight>& net, std::vector<weight>& to) {
+		for (size_t k = 0; k < net.size(); k++)
+			std::memcpy(to[k].data(), net[k].data(), net[k].size() * sizeof(weight::type));
+	}
+
+private:
+	std::shared_ptr<arena> mem[2];
+	std::vector<weight> table[2];
+	std::atomic<unsigned> readers[2];
+	std::atomic<unsigned> current;
+	std::atomic<size_t> version;
+};
@@ -0,0 +1,103 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * pool.h: Persistent thread pool for splitting a search
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * a pool of persistent threads that run the tasks of a job together with the calling thread
+ *
+ * the threads sleep between jobs, and the tasks of a job are taken by an atomic counter,
+ * so a job costs a wake-up and nothing is allocated; the job is passed by reference,
+ * and each task is called with its index and the id of the thread (0 for the caller)
+ */
+class thread_pool {
+public:
+	thread_pool(unsigned threads) : job(nullptr), call(nullptr), total(0), next(0), pending(0), round(0), stop(false) {
+		for (unsigned id = 1; id < threads; id++) worker.emplace_back(&thread_pool::loop, this, id);
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator =(const thread_pool&) = delete;
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : worker) t.join();
+	}
+
+	unsigned size() const { return worker.size() + 1; }
+
+	/**
+	 * run fn(task, thread) for every task in [0, tasks), and return when all are done
+	 */
+	template<typename type>
+	void run(size_t tasks, type& fn) {
+		if (worker.empty()) {
+			for (size_t i = 0; i < tasks; i++) fn(i, 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = &fn;
+			call = &invoke<type>;
+			total = tasks;
+			next.store(0);
+			pending = worker.size();
+			round++;
+		}
+		wake.notify_all();
+		drain(0);
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [this]() { return pending == 0; });
+	}
+
+private:
+	template<typename type>
+	static void invoke(void* fn, size_t task, unsigned id) {
+		(*static_cast<type*>(fn))(task, id);
+	}
+
+	void drain(unsigned id) {
+		for (size_t i; (i = next++) < total; ) call(job, i, id);
+	}
+
+	void loop(unsigned id) {
+		size_t seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [&]() { return stop || round != seen; });
+				if (stop) return;
+				seen = round;
+			}
+			drain(id);
+			std::lock_guard<std::mutex> guard(lock);
+			if (--pending == 0) done.notify_one();
+		}
+	}
+
+private:
+	std::vector<std::thread> worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	void* job;
+	void (*call)(void*, size_t, unsigned);
+	size_t total;
+	std::atomic<size_t> next;
+	unsigned pending;
+	size_t round;
+	bool stop;
+};
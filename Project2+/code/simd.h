@@ -0,0 +1,118 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * simd.h: AVX2 gather-based evaluation of n-tuple networks
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <immintrin.h>
+#include "bitboard.h"
+#include "pattern.h"
+#include "weight.h"
+
+/**
+ * AVX2 evaluation of an n-tuple network, with the 8 isomorphisms of a tuple in 8 lanes
+ *
+ * the board is split into its low and high 32-bit halves, and each lane picks the
+ * half holding its cell and shifts it by its own amount, so the 8 symmetric indices
+ * of a tuple are built in one register and their weights fetched by a single gather
+ *
+ * lanes are summed in the same order as the scalar path, i.e., the tuples of each
+ * isomorphism first, then the isomorphisms in order, so both paths are bit-identical
+ *
+ * the code is compiled for AVX2 by function attributes, and is only called when the
+ * CPU reports AVX2 support at runtime
+ */
+class avx2_network {
+public:
+	avx2_network(const std::vector<pattern>& feature = {}) : tuples(feature.size()), plan(), dense(true) {
+		for (const pattern& p : feature) {
+			for (size_t j = 0; j < pattern::max_length; j++) {
+				lane cell = {};
+				for (unsigned iso = 0; iso < pattern::isomorphism; iso++) {
+					unsigned pos = j < p.length() ? pattern::isomorphic(iso, p.cells()[j]) : 0;
+					cell.shift[iso] = 4 * (pos % 8);
+					cell.high[iso] = pos >= 8 ? -1 : 0;
+				}
+				plan.push_back(cell);
+			}
+			length.push_back(p.length());
+			dense = dense && !p.hashed();
+		}
+	}
+
+	/**
+	 * whether the network can be evaluated by this path, i.e., the CPU supports AVX2
+	 * and every index fits the signed 32-bit offsets of the gather instruction,
+	 * while hashed tuples are left to the scalar path
+	 */
+	static bool supported() {
+		return __builtin_cpu_supports("avx2");
+	}
+	bool applicable() const {
+		for (size_t len : length) if (len >= 8) return false;
+		return dense && tuples > 0 && tuples <= max_tuples;
+	}
+
+	__attribute__((target("avx2")))
+	float estimate(const weight* net, bitboard::raw x) const {
+		__m256i lo = _mm256_set1_epi32(int32_t(x)), hi = _mm256_set1_epi32(int32_t(x >> 32));
+		__m256 acc = _mm256_i32gather_ps(net[0].data(), indices(lo, hi, 0), 4);
+		for (size_t k = 1; k < tuples; k++)
+			acc = _mm256_add_ps(acc, _mm256_i32gather_ps(net[k].data(), indices(lo, hi, k), 4));
+		alignas(32) float part[pattern::isomorphism];
+		_mm256_store_ps(part, acc);
+		float sum = 0.0f;
+		for (unsigned iso = 0; iso < pattern::isomorphism; iso++) sum += part[iso];
+		return sum;
+	}
+
+	/**
+	 * the feature indices of all isomorphisms, stored as idx[iso * tuples + tuple]
+	 */
+	__attribute__((target("avx2")))
+	void indices(bitboard::raw x, uint32_t* idx) const {
+		__m256i lo = _mm256_set1_epi32(int32_t(x)), hi = _mm256_set1_epi32(int32_t(x >> 32));
+		alignas(32) uint32_t lanes[pattern::isomorphism];
+		for (size_t k = 0; k < tuples; k++) {
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), indices(lo, hi, k));
+			for (unsigned iso = 0; iso < pattern::isomorphism; iso++) idx[iso * tuples + k] = lanes[iso];
+		}
+	}
+
+private:
+	/**
+	 * the lanes of a cell of a tuple: the shift within its half, and whether it is in the high half
+	 */
+	struct lane {
+		int32_t shift[pattern::isomorphism];
+		int32_t high[pattern::isomorphism];
+	};
+	static constexpr size_t max_tuples = 32;
+
+	__attribute__((target("avx2")))
+	__m256i indices(__m256i lo, __m256i hi, size_t k) const {
+		const lane* cell = &plan[k * pattern::max_length];
+		const __m256i mask = _mm256_set1_epi32(0x0f);
+		__m256i idx = _mm256_setzero_si256();
+		for (size_t j = 0; j < length[k]; j++, cell++) {
+			__m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cell->high));
+			__m256i half = _mm256_blendv_epi8(lo, hi, high);
+			__m256i shift = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cell->shift));
+			__m256i nibble = _mm256_and_si256(_mm256_srlv_epi32(half, shift), mask);
+			idx = _mm256_or_si256(_mm256_slli_epi32(idx, 4), nibble);
+		}
+		return idx;
+	}
+
+private:
+	size_t tuples;
+	std::vector<lane> plan;
+	std::vector<size_t> length;
+	bool dense;
+};
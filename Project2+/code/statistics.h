@@ -12,6 +12,8 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <functional>
+#include <chrono>
 #include "board.h"
 #include "action.h"
 #include "episode.h"
@@ -29,7 +31,10 @@ public:
 		: total(total),
 		  block(block ? block : total),
 		  limit(limit ? limit : total),
-		  count(0) {}
+		  count(0),
+		  goal(0),
+		  reached(0),
+		  slim(false) {}
 
 public:
 	/**
@@ -52,6 +57,9 @@ public:
 	 *                                   the average speed of the placer is 955796
 	 * '84.1%': 84.1% of the games reached 24-tiles, i.e., win rate of 24-tile
 	 * '45.3%': 45.3% of the games terminated with 24-tiles as the largest tile
+	 *
+	 * the speeds are taken from the times recorded in the episodes, or, for games played
+	 * in overlap (see elapse), from the moves and times counted since the last block
 	 */
 	void show(bool tstat = true, size_t blk = 0) const {
 		size_t num = std::min(data.size(), blk ?: block);
@@ -79,12 +87,24 @@ public:
 		std::cout << count << "\t";
 		std::cout << "avg = " << (sum / num) << ", ";
 		std::cout << "max = " << (max) << ", ";
+		if (overlap.on && blk == 0) {
+			auto now = std::chrono::steady_clock::now();
+			pop = overlap.moves[0], eop = overlap.moves[1], sop = pop + eop;
+			sdu = std::chrono::duration_cast<std::chrono::milliseconds>(now - overlap.since).count();
+			pdu = overlap.nsec[0] / 1000000, edu = overlap.nsec[1] / 1000000;
+			overlap = lap(now);
+		}
 		std::cout << "ops = " << (sop * 1000.0 / sdu);
 		std::cout <<     " (" << (pop * 1000.0 / pdu);
 		std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
 		std::cout << std::endl;
 		std::cout.copyfmt(ff);
 
+		if (goal && !reached && blk == 0 && sum / num >= goal) {
+			reached = count;
+			std::cout << "target = " << goal << " reached in " << reached << " episodes" << std::endl;
+		}
+
 		if (!tstat) return;
 		for (size_t t = 0, c = 0; c < num; c += stat[t++]) {
 			if (stat[t] == 0) continue;
@@ -101,19 +121,78 @@ public:
 		show(true, data.size());
 	}
 
+	/**
+	 * report the first block whose average score reaches the target, e.g.,
+	 * target = 5000 reached in 3000 episodes
+	 * which allows comparing how fast different settings learn
+	 */
+	void target(board::score score) {
+		goal = score;
+	}
+
+	/**
+	 * keep only the aggregates of episodes (see episode), for training runs that never save them
+	 */
+	void lean(bool on) {
+		slim = on;
+	}
+	bool lean() const {
+		return slim;
+	}
+	/**
+	 * a hook called with the current index after every block is shown, e.g., to write telemetry
+	 */
+	void monitor(std::function<void(size_t)> hook) {
+		on_block = hook;
+	}
+	/**
+	 * count the moves of the slider (who = 0) or the placer (who = 1) of games played in overlap,
+	 * e.g., by batch_env, and the nanoseconds spent on them, so that the speeds of a block are
+	 * taken over its wall time, since the durations of the episodes overlap and their moves
+	 * mostly take less than the millisecond they are recorded in
+	 */
+	void elapse(unsigned who, size_t moves, int64_t nsec) {
+		if (!overlap.on) overlap = lap(std::chrono::steady_clock::now());
+		overlap.moves[who] += moves;
+		overlap.nsec[who] += nsec;
+	}
+	/**
+	 * count the moves of an episode played in overlap with others, e.g., by another thread,
+	 * with the times recorded in it
+	 */
+	void elapse(const episode& ep) {
+		elapse(0, ep.step(action::slide::type), int64_t(ep.time(action::slide::type)) * 1000000);
+		elapse(1, ep.step(action::place::type), int64_t(ep.time(action::place::type)) * 1000000);
+	}
+	/**
+	 * a new episode in the recording mode of the statistics, for episodes played elsewhere
+	 */
+	episode new_episode() const {
+		return episode(slim);
+	}
+
 	bool is_finished() const {
 		return count >= total;
 	}
 
 	void open_episode(const std::string& flag = "") {
 		if (count++ >= limit) data.pop_front();
-		data.emplace_back();
+		data.emplace_back(slim);
 		data.back().open_episode(flag);
 	}
 
 	void close_episode(const std::string& flag = "") {
 		data.back().close_episode(flag);
-		if (count % block == 0) show();
+		if (count % block == 0) show(), notify();
+	}
+
+	/**
+	 * append an episode that was opened and closed elsewhere, e.g., by a worker thread
+	 */
+	void append(episode&& ep) {
+		if (count++ >= limit) data.pop_front();
+		data.push_back(std::move(ep));
+		if (count % block == 0) show(), notify();
 	}
 
 	episode& at(size_t i) {
@@ -143,10 +222,31 @@ public:
 		return in;
 	}
 
+private:
+	void notify() const {
+		if (on_block) on_block(count);
+	}
+
+	/**
+	 * the moves and times counted by elapse() since the last block
+	 */
+	struct lap {
+		bool on;
+		std::chrono::steady_clock::time_point since;
+		size_t moves[2];
+		int64_t nsec[2];
+		lap(std::chrono::steady_clock::time_point since = {}, bool on = true) : on(on), since(since), moves(), nsec() {}
+	};
+
 private:
 	size_t total;
 	size_t block;
 	size_t limit;
 	size_t count;
+	board::score goal;
+	mutable size_t reached;
+	bool slim;
 	std::deque<episode> data;
+	std::function<void(size_t)> on_block;
+	mutable lap overlap = lap({}, false);
 };
@@ -0,0 +1,143 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * telemetry.h: Counters of the training speed, TD error, and memory
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <iomanip>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unistd.h>
+
+/**
+ * the counters of training, shared by all sliders (and their worker copies) of a run
+ *
+ * a slider counts into a tally of its own without any synchronization,
+ * and adds the tally into the shared counters once per episode
+ */
+class telemetry {
+public:
+	struct tally {
+		uint64_t slides = 0;     // move decisions
+		uint64_t estimates = 0;  // afterstate evaluations, by decisions and by updates
+		uint64_t updates = 0;    // TD updates, one per afterstate of a path
+		double td_sum = 0;       // sum of TD errors
+		double td_square = 0;    // sum of squared TD errors
+		double play = 0;         // seconds outside update()
+		double learn = 0;        // seconds in update()
+		uint64_t depth[5] = { 0, 0, 0, 0, 0 }; // moves by the depth reached by iterative deepening
+
+		tally& operator +=(const tally& t) {
+			slides += t.slides;
+			estimates += t.estimates;
+			updates += t.updates;
+			td_sum += t.td_sum;
+			td_square += t.td_square;
+			play += t.play;
+			learn += t.learn;
+			for (unsigned d = 0; d < 5; d++) depth[d] += t.depth[d];
+			return *this;
+		}
+	};
+
+public:
+	telemetry() : start(std::chrono::steady_clock::now()), last(start), last_episode(0), header(false) {}
+
+	void add(const tally& t) {
+		std::lock_guard<std::mutex> guard(lock);
+		total += t;
+		for (unsigned d = 0; d < 5; d++) reached[d] += t.depth[d];
+	}
+
+	/**
+	 * write a record of the counters since the last record, as a CSV row,
+	 * or a JSON line if 'json' is set, e.g.,
+	 * {"episode":1000,"time":4.9,"episodes_per_sec":204,"slides_per_sec":104603,"updates_per_sec":104012,
+	 *  "estimates_per_sec":1905866,"td_mean":-0.41,"td_rms":53.2,"play_share":0.83,"update_share":0.17,
+	 *  "depth_mean":0,"weight_bytes":268435456,"rss_bytes":300519424}
+	 * where the rates are over the wall time, the shares are of the time summed over all sliders,
+	 * and 'depth_mean' is the mean depth reached by iterative deepening (0 if not used)
+	 */
+	void report(std::ostream& out, size_t episode, size_t weight_bytes, bool json) {
+		tally t;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			t = total;
+			total = tally();
+		}
+		auto now = std::chrono::steady_clock::now();
+		double sec = std::chrono::duration<double>(now - last).count();
+		double time = std::chrono::duration<double>(now - start).count();
+		double rate = sec > 0 ? 1 / sec : 0;
+		double spent = t.play + t.learn;
+		uint64_t moves = 0, layers = 0;
+		for (unsigned d = 1; d < 5; d++) moves += t.depth[d], layers += d * t.depth[d];
+		const char* name[] = { "episode", "time", "episodes_per_sec", "slides_per_sec", "updates_per_sec", "estimates_per_sec",
+			"td_mean", "td_rms", "play_share", "update_share", "depth_mean", "weight_bytes", "rss_bytes" };
+		double value[] = { double(episode), time, (episode - last_episode) * rate, t.slides * rate, t.updates * rate, t.estimates * rate,
+			t.updates ? t.td_sum / t.updates : 0, t.updates ? std::sqrt(t.td_square / t.updates) : 0,
+			spent > 0 ? t.play / spent : 0, spent > 0 ? t.learn / spent : 0, moves ? double(layers) / moves : 0,
+			double(weight_bytes), double(rss()) };
+		int digits[] = { 0, 1, 0, 0, 0, 0, 4, 4, 3, 3, 2, 0, 0 };
+		size_t num = sizeof(value) / sizeof(value[0]);
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed;
+		if (!json && !header) {
+			for (size_t i = 0; i < num; i++) out << (i ? "," : "") << name[i];
+			out << std::endl;
+			header = true;
+		}
+		out << (json ? "{" : "");
+		for (size_t i = 0; i < num; i++) {
+			out << (i ? "," : "");
+			if (json) out << '"' << name[i] << "\":";
+			out << std::setprecision(digits[i]) << value[i];
+		}
+		out << (json ? "}" : "") << std::endl;
+		out.copyfmt(ff);
+		last = now;
+		last_episode = episode;
+	}
+
+	/**
+	 * print the distribution of the depths reached by iterative deepening over the whole run, e.g.,
+	 * 1 = 0.4%, 2 = 31.7%, 3 = 67.9%, 4 = 0% of 120345 moves
+	 */
+	void depths(std::ostream& out) {
+		std::lock_guard<std::mutex> guard(lock);
+		uint64_t moves = 0;
+		for (unsigned d = 1; d < 5; d++) moves += reached[d];
+		for (unsigned d = 1; d < 5; d++)
+			out << (d > 1 ? ", " : "") << d << " = " << (moves ? 100.0 * reached[d] / moves : 0.0) << "%";
+		out << " of " << moves << " moves" << std::endl;
+	}
+
+	/**
+	 * the resident set size of this process in bytes, read from /proc/self/statm
+	 */
+	static size_t rss() {
+		std::ifstream statm("/proc/self/statm");
+		size_t pages = 0, resident = 0;
+		statm >> pages >> resident;
+		return resident * sysconf(_SC_PAGESIZE);
+	}
+
+private:
+	std::mutex lock;
+	tally total;
+	uint64_t reached[5] = { 0, 0, 0, 0, 0 };
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point last;
+	size_t last_episode;
+	bool header;
+};
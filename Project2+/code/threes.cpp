@@ -11,20 +11,164 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistics.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "eval.h"
+
+/**
+ * play an episode to the end, and collect the afterstates of the slider into the path
+ */
+agent& play(episode& game, learning_slider& slide, random_placer& place, trajectory& path) {
+	while (true) {
+		float state_value = 0.0;
+		int reward = 0;
+		agent& who = game.take_turns(slide, place);
+		action move = who.take_action(game.state(), state_value, reward);
+//		std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
+		if (game.apply_action(move) != true) break;
+
+		if (reward != 0 || state_value != 0) {
+			path.push(game.state(), reward, state_value);		//store afterstate value to calculate td error
+		}
+		if (who.check_for_win(game.state())) break;
+	}
+	return game.last_turns(slide, place);
+}
+
+/**
+ * train by many threads that share the weight tables and update them without locks (Hogwild)
+ * each worker has its own slider, placer, and path, and its finished episodes are appended
+ * to the statistics under a lock, so the blocks are reported as in the single-threaded run,
+ * except that the overall speed is taken over the wall time, since the episodes overlap
+ */
+void hogwild(learning_slider& slide, random_placer& place, statistics& stats, size_t total, size_t threads, evaluator* judge) {
+	std::atomic<size_t> next(stats.step());
+	std::mutex lock;
+	std::vector<std::thread> workers;
+	for (unsigned id = 0; id < threads; id++) {
+		workers.emplace_back([&, id]() {
+			learning_slider slide_w = slide.worker(id);
+			random_placer place_w = place;
+			place_w.seed_worker(id);
+			trajectory path;
+			while (next++ < total) {
+				slide_w.open_episode("~:" + place_w.name());
+				place_w.open_episode(slide_w.name() + ":~");
+				episode game = stats.new_episode();
+				game.open_episode(slide_w.name() + ":" + place_w.name());
+				agent& win = play(game, slide_w, place_w, path);
+				game.close_episode(win.name());
+				std::string flag = win.name();
+				size_t learned;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					stats.elapse(game);
+					stats.append(std::move(game));
+					learned = stats.step();
+				}
+				slide_w.update(path);
+				if (judge) judge->offer(slide.weights(), learned);
+				path.clear();
+				slide_w.close_episode(flag);
+				place_w.close_episode(flag);
+			}
+		});
+	}
+	for (std::thread& worker : workers) worker.join();
+}
+
+/**
+ * train by actor threads that play with a snapshot of the weight tables, and a single learner
+ * (this thread) that updates the weight tables from the trajectories of the actors
+ *
+ * the actors push their finished episodes and paths into a bounded lock-free queue, waiting
+ * only when the queue is full, and the learner publishes a new snapshot every 'refresh'
+ * updates, which the actors pick up at the start of their next episodes
+ */
+void actor_learner(learning_slider& slide, random_placer& place, statistics& stats, size_t total, size_t block,
+		size_t actors, size_t refresh, size_t capacity, evaluator* judge) {
+	struct rollout {
+		episode game;
+		trajectory path;
+	};
+	mpsc_queue<rollout> queue(capacity);
+	snapshot snap(slide.weights(), slide.page());
+	std::atomic<size_t> next(stats.step()), produced(0), stalls(0);
+	std::vector<std::thread> workers;
+	for (unsigned id = 0; id < actors; id++) {
+		workers.emplace_back([&, id]() {
+			learning_slider slide_a = slide.snapshot_worker(id);
+			random_placer place_a = place;
+			place_a.seed_worker(id);
+			rollout item;
+			while (next++ < total) {
+				unsigned buffer = snap.acquire();
+				slide_a.bind(snap.tables(buffer));
+				slide_a.open_episode("~:" + place_a.name());
+				place_a.open_episode(slide_a.name() + ":~");
+				item.game = stats.new_episode();
+				item.game.open_episode(slide_a.name() + ":" + place_a.name());
+				agent& win = play(item.game, slide_a, place_a, item.path);
+				item.game.close_episode(win.name());
+				slide_a.close_episode(win.name());
+				place_a.close_episode(win.name());
+				snap.release(buffer);
+				for (size_t wait = 0; !queue.push(item); wait++) {
+					if (wait == 0) stalls++;
+					std::this_thread::yield();
+				}
+				item.path.clear();
+				produced++;
+			}
+		});
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	size_t goal = total > stats.step() ? total - stats.step() : 0, learned = 0;
+	bool pending = false;
+	rollout item;
+	while (learned < goal) {
+		if (!queue.pop(item)) {
+			std::this_thread::yield();
+			continue;
+		}
+		stats.elapse(item.game);
+		stats.append(std::move(item.game));
+		slide.update(item.path);
+		learned++;
+		if (judge) judge->offer(slide.weights(), stats.step());
+		if (learned % refresh == 0 || pending)
+			pending = !snap.publish(slide.weights());
+		if (learned % block == 0) {
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "pipeline: queue = " << queue.size() << "/" << queue.capacity();
+			std::cout << ", actors = " << produced << " (" << size_t(produced / sec) << "/s)";
+			std::cout << ", learner = " << learned << " (" << size_t(learned / sec) << "/s)";
+			std::cout << ", snapshots = " << snap.versions() << ", stalls = " << stalls << std::endl << std::endl;
+		}
+	}
+	for (std::thread& worker : workers) worker.join();
+}
 
 int main(int argc, const char* argv[]) {
 	std::cout << "Threes! Demo: ";
 	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
 	std::cout << std::endl << std::endl;
 
-	size_t total = 1000, block = 0, limit = 0;
+	size_t total = 1000, block = 0, limit = 0, threads = 1;
+	size_t actors = 0, refresh = 100, capacity = 64, batch = 0, target = 0, eval = 0, eval_every = 0;
+	bool lean = false;
 	std::string slide_args, place_args;
-	std::string load_path, save_path;
+	std::string load_path, save_path, telemetry_path;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		auto match_arg = [&](std::string flag) -> bool {
@@ -41,6 +185,24 @@ int main(int argc, const char* argv[]) {
 			block = std::stoull(next_opt());
 		} else if (match_arg("limit")) {
 			limit = std::stoull(next_opt());
+		} else if (match_arg("threads")) {
+			threads = std::stoull(next_opt());
+		} else if (match_arg("lean")) {
+			lean = true;
+		} else if (match_arg("target")) {
+			target = std::stoull(next_opt());
+		} else if (match_arg("eval_every")) {
+			eval_every = std::stoull(next_opt());
+		} else if (match_arg("eval")) {
+			eval = std::stoull(next_opt());
+		} else if (match_arg("batch")) {
+			batch = std::stoull(next_opt());
+		} else if (match_arg("actors")) {
+			actors = std::stoull(next_opt());
+		} else if (match_arg("refresh")) {
+			refresh = std::max<size_t>(std::stoull(next_opt()), 1);
+		} else if (match_arg("queue")) {
+			capacity = std::stoull(next_opt());
 		} else if (match_arg("slide") || match_arg("play")) {
 			slide_args = next_opt();
 		} else if (match_arg("place") || match_arg("env")) {
@@ -49,10 +211,18 @@ int main(int argc, const char* argv[]) {
 			load_path = next_opt();
 		} else if (match_arg("save")) {
 			save_path = next_opt();
+		} else if (match_arg("telemetry")) {
+			telemetry_path = next_opt();
 		}
 	}
 
 	statistics stats(total, block, limit);
+	stats.target(target);
+	stats.lean(lean);
+	if (lean && save_path.size()) {
+		std::cerr << "no move is recorded in lean mode, --save=" << save_path << " is ignored" << std::endl;
+		save_path.clear();
+	}
 
 	if (load_path.size()) {
 		std::ifstream in(load_path, std::ios::in);
@@ -65,8 +235,29 @@ int main(int argc, const char* argv[]) {
 	random_placer place(place_args);
 	// greedy_slider slide(slide_args);
 	learning_slider slide(slide_args);
-	std::vector<state> path;
+	if (threads > 1 && slide.synced()) {
+		std::cerr << "sync= counts the episodes of a single thread, and cannot be used with --threads=" << threads << std::endl;
+		std::exit(-1);
+	}
+	trajectory path;
+	std::ofstream telemetry_out;
+	if (telemetry_path.size()) {
+		telemetry_out.open(telemetry_path, std::ios::out | std::ios::trunc);
+		bool json = telemetry_path.find(".json") != std::string::npos;
+		stats.monitor([&, json](size_t count) {
+			slide.meter().report(telemetry_out, count, slide.memory(), json);
+		});
+	}
+	std::unique_ptr<evaluator> judge;
+	if (eval > 0) judge.reset(new evaluator(slide, place_args, eval, eval_every ? eval_every : block ? block : 1000));
 
+	if (batch > 0) {
+		batch_env(batch, slide, place, judge.get()).run(stats, total);
+	} else if (actors > 0) {
+		actor_learner(slide, place, stats, total, block ? block : total, actors, refresh, capacity, judge.get());
+	} else if (threads > 1) {
+		hogwild(slide, place, stats, total, threads, judge.get());
+	}
 	while (!stats.is_finished()) {
 //		std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
 		slide.open_episode("~:" + place.name());
@@ -74,28 +265,11 @@ int main(int argc, const char* argv[]) {
 
 		stats.open_episode(slide.name() + ":" + place.name());
 		episode& game = stats.back();
-		while (true) {
-			float state_value = 0.0;
-			int reward = 0;
-			state s1;
-			s1.board_before = game.state();
-			agent& who = game.take_turns(slide, place);
-			action move = who.take_action(game.state(), state_value, reward);
-//			std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
-			if (game.apply_action(move) != true) break;
-			s1.board_after = game.state();
-			s1.reward = reward;
-			s1.value = state_value;		//store afterstate value to calculate td error
-
-			if (reward != 0 || state_value != 0) {
-				path.push_back(s1);
-			}
-			if (who.check_for_win(game.state())) break;
-		}
-		agent& win = game.last_turns(slide, place);
+		agent& win = play(game, slide, place, path);
 		stats.close_episode(win.name());
 		slide.update(path);
     	path.clear();
+		if (judge) judge->offer(slide.weights(), stats.step());
 		slide.close_episode(win.name());
 		place.close_episode(win.name());
 	}
@@ -0,0 +1,156 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * transposition.h: Lock-free transposition table for expectimax search
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include "bitboard.h"
+
+/**
+ * a fixed-size transposition table of the values of search nodes, shared without locks
+ *
+ * a node is keyed on its cells and its attributes (hint, last move, and bag), and stored with
+ * its type and depth, where a leaf is an afterstate evaluated by the network (whose value
+ * depends only on the cells), and a chance node is an afterstate searched 'depth' layers deep
+ *
+ * an entry is a pair of 64-bit words, the data (value, attributes, depth, type, generation)
+ * and the cells xor the data, so that an entry torn by concurrent writers fails the check
+ * and is treated as a miss (lockless hashing), and no lock is ever taken
+ *
+ * the entries are paired into buckets, where the first slot keeps the deeper node unless it is
+ * of an older generation, and the second slot is always replaced
+ * the generation is advanced when the weights change, which invalidates all entries at once
+ */
+class transposition {
+public:
+	enum node { leaf = 0, chance = 1 };
+	/**
+	 * the probes and hits of a searcher, per node type, merged into the table from time to time
+	 */
+	struct counters {
+		uint64_t probes[2] = { 0, 0 };
+		uint64_t hits[2] = { 0, 0 };
+	};
+
+public:
+	transposition(unsigned bits) : bits(bits), table(new entry[size_t(1) << bits]), gen(1) {
+		clear();
+		for (unsigned t = 0; t < 2; t++) probes[t].store(0), hits[t].store(0);
+	}
+	transposition(const transposition&) = delete;
+	transposition& operator =(const transposition&) = delete;
+
+	unsigned log_size() const { return bits; }
+
+	/**
+	 * look up a node, and set its value if found
+	 */
+	bool probe(const bitboard& b, node type, unsigned depth, float& value, counters& c) const {
+		c.probes[type]++;
+		uint64_t tag = pack(b, type, depth, 0) >> 32;
+		const entry* e = bucket(b, type, depth);
+		for (unsigned i = 0; i < 2; i++) {
+			uint64_t data = e[i].data.load(std::memory_order_relaxed);
+			uint64_t lock = e[i].lock.load(std::memory_order_relaxed);
+			if ((lock ^ data) != b.cells() || (data >> 32) != tag) continue;
+			uint32_t word = uint32_t(data);
+			std::memcpy(&value, &word, sizeof(float));
+			c.hits[type]++;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * store the value of a node
+	 */
+	void store(const bitboard& b, node type, unsigned depth, float value) {
+		uint32_t word;
+		std::memcpy(&word, &value, sizeof(float));
+		uint64_t data = pack(b, type, depth, word);
+		entry* e = bucket(b, type, depth);
+		uint64_t first = e[0].data.load(std::memory_order_relaxed);
+		bool keep = (first >> 56) == generation() && ((first >> 52) & 0x07u) > depth;
+		entry& slot = e[keep ? 1 : 0];
+		slot.data.store(data, std::memory_order_relaxed);
+		slot.lock.store(b.cells() ^ data, std::memory_order_relaxed);
+	}
+
+	/**
+	 * invalidate all entries, e.g., after the weights are updated
+	 */
+	void advance() {
+		if (gen.fetch_add(1) + 1 == 256) {
+			gen.store(1);
+			clear();
+		}
+	}
+
+	void merge(counters& c) {
+		for (unsigned t = 0; t < 2; t++) {
+			probes[t] += c.probes[t];
+			hits[t] += c.hits[t];
+		}
+		c = counters();
+	}
+
+	/**
+	 * print the hit rates, e.g.,
+	 * 4194304 entries, leaf: 1843200 probes, 41.2% hits, chance: 230400 probes, 63.5% hits
+	 */
+	void report(std::ostream& out) const {
+		const char* name[] = { "leaf", "chance" };
+		out << (size_t(1) << bits) << " entries";
+		for (unsigned t = 0; t < 2; t++) {
+			uint64_t p = probes[t].load(), h = hits[t].load();
+			out << ", " << name[t] << ": " << p << " probes, " << (p ? 100.0 * h / p : 0.0) << "% hits";
+		}
+		out << std::endl;
+	}
+
+private:
+	struct entry {
+		std::atomic<uint64_t> lock;
+		std::atomic<uint64_t> data;
+	};
+
+	/**
+	 * value (32 bits), attributes (20 bits), depth (3 bits), type (1 bit), and generation (8 bits)
+	 * a leaf ignores the attributes, since the network reads only the cells
+	 */
+	uint64_t pack(const bitboard& b, node type, unsigned depth, uint32_t value) const {
+		uint64_t attr = type == leaf ? 0 : b.info() & 0xfffffu;
+		return value | attr << 32 | uint64_t(depth & 0x07u) << 52 | uint64_t(type) << 55 | generation() << 56;
+	}
+	uint64_t generation() const {
+		return gen.load(std::memory_order_relaxed);
+	}
+	entry* bucket(const bitboard& b, node type, unsigned depth) const {
+		uint64_t attr = type == leaf ? 0 : b.info() & 0xfffffu;
+		uint64_t key = b.cells() ^ ((attr << 4 | depth << 1 | type) * 0xbf58476d1ce4e5b9ull);
+		key *= 0x9e3779b97f4a7c15ull;
+		return &table[(key >> (64 - bits)) & ~size_t(1)];
+	}
+	void clear() {
+		for (size_t i = 0; i < (size_t(1) << bits); i++) {
+			table[i].lock.store(0, std::memory_order_relaxed);
+			table[i].data.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	unsigned bits;
+	std::unique_ptr<entry[]> table;
+	std::atomic<uint64_t> gen;
+	std::atomic<uint64_t> probes[2];
+	std::atomic<uint64_t> hits[2];
+};
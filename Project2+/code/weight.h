@@ -9,41 +9,308 @@
 
 #pragma once
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <utility>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <sys/mman.h>
 
+/**
+ * a single contiguous block of memory that holds all weight tables
+ *
+ * the block is aligned to 2M so that it can be backed by huge pages, selected by
+ * normal:      default pages of the system
+ * thp:         transparent huge pages, requested by madvise(MADV_HUGEPAGE)
+ * hugetlb:     explicit huge pages from hugetlbfs, falls back to thp if none is reserved
+ *
+ * all pages are touched at allocation, so that no page fault happens during training
+ */
+class arena {
+public:
+	static constexpr size_t huge_page = 2 << 20;
+	enum mode { normal, thp, hugetlb };
+
+public:
+	arena(size_t bytes, mode type = normal) : base(nullptr), bytes(align(bytes)), map(nullptr), mapped(0), type(type) {
+		if (type == hugetlb) {
+			mapped = this->bytes;
+			map = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (map == MAP_FAILED) {
+				std::cerr << "no hugetlb page is available, fall back to thp" << std::endl;
+				this->type = type = thp;
+			}
+		}
+		if (type != hugetlb) {
+			mapped = this->bytes + huge_page;
+			map = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (map == MAP_FAILED) throw std::bad_alloc();
+		}
+		base = reinterpret_cast<char*>(align(reinterpret_cast<size_t>(map)));
+		if (type == thp) madvise(base, this->bytes, MADV_HUGEPAGE);
+		for (size_t i = 0; i < this->bytes; i += 4096) base[i] = 0;
+	}
+	arena(const arena&) = delete;
+	arena& operator =(const arena&) = delete;
+	~arena() { munmap(map, mapped); }
+
+	char* data() const { return base; }
+	size_t size() const { return bytes; }
+
+	static mode parse(const std::string& name) {
+		if (name == "thp") return thp;
+		if (name == "hugetlb" || name == "huge") return hugetlb;
+		return normal;
+	}
+	static size_t align(size_t n) { return (n + huge_page - 1) / huge_page * huge_page; }
+
+	/**
+	 * an arena of the given page type holding tables of the given sizes in bytes,
+	 * each starting on a 64-byte cache line, whose starts are stored into 'slices'
+	 */
+	static std::shared_ptr<arena> carve(const std::vector<size_t>& sizes, mode type, std::vector<char*>& slices) {
+		auto line = [](size_t n) { return (n + 63) / 64 * 64; };
+		size_t total = 0;
+		for (size_t n : sizes) total += line(n);
+		auto mem = std::make_shared<arena>(total, type);
+		slices.clear();
+		char* base = mem->data();
+		for (size_t n : sizes) slices.push_back(base), base += line(n);
+		return mem;
+	}
+
+	/**
+	 * print the page statistics of the arena, e.g.,
+	 * arena: 256M at 0x7f3a40000000, page=thp, 128 of 128 huge pages (TLB entries: 128, or 65536 with small pages)
+	 */
+	void report(std::ostream& out) const {
+		const char* name[] = { "normal", "thp", "hugetlb" };
+		size_t huge = type == hugetlb ? bytes : huge_bytes();
+		size_t small = (bytes - huge) / 4096;
+		out << "arena: " << (bytes >> 20) << "M at " << static_cast<const void*>(base);
+		out << ", page=" << name[type];
+		out << ", " << (huge / huge_page) << " of " << (bytes / huge_page) << " huge pages";
+		out << " (TLB entries: " << (huge / huge_page + small) << ", or " << (bytes / 4096) << " with small pages)" << std::endl;
+	}
+
+private:
+	/**
+	 * the bytes of the arena backed by transparent huge pages, read from /proc/self/smaps
+	 */
+	size_t huge_bytes() const {
+		std::ifstream smaps("/proc/self/smaps");
+		size_t lo = reinterpret_cast<size_t>(map), hi = lo + mapped, huge = 0;
+		bool inside = false;
+		for (std::string line; std::getline(smaps, line); ) {
+			size_t from, to;
+			char dash;
+			if (std::isxdigit(line[0]) && (std::stringstream(line) >> std::hex >> from >> dash >> to)) {
+				inside = from < hi && to > lo;
+			} else if (inside && line.find("AnonHugePages:") == 0) {
+				size_t kb = 0;
+				std::stringstream(line.substr(14)) >> kb;
+				huge += kb << 10;
+			}
+		}
+		return huge;
+	}
+
+private:
+	char* base;
+	size_t bytes;
+	void* map;
+	size_t mapped;
+	mode type;
+};
+
+/**
+ * a weight table, viewing a slice of an arena
+ */
 class weight {
 public:
 	typedef float type;
 
 public:
-	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
+	weight() : value(nullptr), length(0) {}
+	weight(type* data, size_t len) : value(data), length(len) {}
 	weight(const weight& f) = default;
 
 	weight& operator =(const weight& f) = default;
 	type& operator[] (size_t i) { return value[i]; }
 	const type& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	size_t size() const { return length; }
+	type* data() { return value; }
+	const type* data() const { return value; }
 
 public:
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
-		auto& value = w.value;
-		uint64_t size = value.size();
+		uint64_t size = w.length;
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+		out.write(reinterpret_cast<const char*>(w.value), sizeof(type) * size);
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, weight& w) {
-		auto& value = w.value;
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
-		value.resize(size);
-		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
+		if (size != w.length) return in.setstate(std::ios::failbit), in;
+		in.read(reinterpret_cast<char*>(w.value), sizeof(type) * size);
 		return in;
 	}
 
 protected:
-	std::vector<type> value;
+	type* value;
+	size_t length;
+};
+
+/**
+ * the accumulated error (E) and accumulated absolute error (A) of every weight of a table,
+ * for temporal coherence learning, viewing a slice of an arena
+ *
+ * the two are kept in pairs, so that an update of a weight touches a single 8-byte entry
+ */
+class coherence {
+public:
+	struct entry {
+		float error;
+		float absolute;
+	};
+
+public:
+	coherence(entry* data = nullptr, size_t len = 0) : value(data), length(len) {}
+
+	entry& operator[] (size_t i) { return value[i]; }
+	const entry& operator[] (size_t i) const { return value[i]; }
+	size_t size() const { return length; }
+	entry* data() { return value; }
+	const entry* data() const { return value; }
+
+public:
+	friend std::ostream& operator <<(std::ostream& out, const coherence& c) {
+		uint64_t size = c.length;
+		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+		out.write(reinterpret_cast<const char*>(c.value), sizeof(entry) * size);
+		return out;
+	}
+	friend std::istream& operator >>(std::istream& in, coherence& c) {
+		uint64_t size = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+		if (size != c.length) return in.setstate(std::ios::failbit), in;
+		in.read(reinterpret_cast<char*>(c.value), sizeof(entry) * size);
+		return in;
+	}
+
+protected:
+	entry* value;
+	size_t length;
+};
+
+/**
+ * the collision statistics of a hashed weight table
+ *
+ * each slot keeps the tag of the last tuple index written to it, and a write whose tag
+ * differs from the tag in its slot is counted as a collision, i.e., the slot is shared
+ * by different tuple indices (a few are missed when two indices have the same tag)
+ */
+class collision {
+public:
+	collision(size_t slots = 0) : tag(slots), writes(0), clashes(0) {}
+
+	void record(uint32_t slot, uint8_t t) {
+		writes++;
+		clashes += (tag[slot] != 0 && tag[slot] != t);
+		tag[slot] = t;
+	}
+	size_t slots() const { return tag.size(); }
+	size_t used() const { return tag.size() - std::count(tag.begin(), tag.end(), 0); }
+
+	/**
+	 * print the statistics, e.g.,
+	 * 4194304 slots, 71.3% used, 52428800 writes, 6.1% collisions
+	 */
+	void report(std::ostream& out) const {
+		out << slots() << " slots, " << (100.0 * used() / slots()) << "% used, ";
+		out << writes << " writes, " << (writes ? 100.0 * clashes / writes : 0.0) << "% collisions" << std::endl;
+	}
+
+private:
+	std::vector<uint8_t> tag;
+	uint64_t writes;
+	uint64_t clashes;
+};
+
+/**
+ * a weight table quantized for evaluation, viewing a slice of an arena
+ *
+ * int16: each weight is rounded to code * scale, where scale = max |weight| / 32767
+ * fp16:  each weight is rounded to the nearest IEEE 754 half-precision value
+ *
+ * both take 2 bytes per weight, i.e., half the memory of weight::type
+ */
+class qweight {
+public:
+	enum format { int16, fp16 };
+
+public:
+	qweight(uint16_t* data = nullptr, size_t len = 0, format type = int16, float scale = 1) :
+		value(data), length(len), type(type), scale(scale) {}
+
+	float operator[] (size_t i) const { return type == int16 ? int16_t(value[i]) * scale : half_to_float(value[i]); }
+	size_t size() const { return length; }
+	const uint16_t* data() const { return value; }
+	format kind() const { return type; }
+	float unit() const { return scale; }
+
+	/**
+	 * quantize a weight table into the given storage, which holds w.size() codes
+	 */
+	static qweight quantize(const weight& w, uint16_t* data, format type) {
+		float scale = 1;
+		if (type == int16) {
+			float max = 0;
+			for (size_t i = 0; i < w.size(); i++) max = std::max(max, std::abs(w[i]));
+			scale = max > 0 ? max / 32767 : 1;
+			for (size_t i = 0; i < w.size(); i++) data[i] = uint16_t(int16_t(std::lround(w[i] / scale)));
+		} else {
+			for (size_t i = 0; i < w.size(); i++) data[i] = float_to_half(w[i]);
+		}
+		return qweight(data, w.size(), type, scale);
+	}
+
+	static format parse(const std::string& name) {
+		return name == "fp16" ? fp16 : int16;
+	}
+
+public:
+	static float half_to_float(uint16_t h) {
+		union { uint32_t u; float f; } o = { uint32_t(h & 0x7fffu) << 13 };
+		o.f *= 5.192296858534828e+33f; // 2^112, rebias the exponent and handle subnormals
+		if (o.f >= 65536.0f) o.u |= 0xffu << 23; // infinity or NaN
+		o.u |= uint32_t(h & 0x8000u) << 16;
+		return o.f;
+	}
+	static uint16_t float_to_half(float v) {
+		union { float f; uint32_t u; } in = { v };
+		uint32_t sign = (in.u >> 16) & 0x8000u;
+		uint32_t abs = in.u & 0x7fffffffu;
+		if (abs >= 0x47800000u) // overflow, infinity, or NaN
+			return sign | (abs > 0x7f800000u ? 0x7e00u : 0x7c00u);
+		if (abs < 0x38800000u) { // subnormal or zero, round to nearest even by float addition
+			union { uint32_t u; float f; } x = { abs }, magic = { 0x3f000000u }; // 0.5
+			x.f += magic.f;
+			return sign | uint16_t(x.u - magic.u);
+		}
+		uint32_t odd = (abs >> 13) & 1;
+		abs += 0xc8000fffu + odd; // rebias the exponent and round to nearest even
+		return sign | uint16_t(abs >> 13);
+	}
+
+protected:
+	uint16_t* value;
+	size_t length;
+	format type;
+	float scale;
 };